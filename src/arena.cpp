@@ -0,0 +1,166 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "arena.hpp"
+#include "rom.hpp"
+
+ArenaRom::~ArenaRom() {
+    // VMs keep their mappings; the kernel frees the file with the last one
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+#ifdef __linux__
+// A sealed memfd holding the image, or -1
+static int create_memfd(const RomImage& rom) {
+    char name[32];
+    snprintf(name, sizeof(name), "chip8-%016llx", (unsigned long long) rom.hash());
+    int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+        return -1;
+    // Sealed so the shared pages can never change under a VM
+    ssize_t size = rom.image_size();
+    if (pwrite(fd, rom.image(), size, 0) != size
+        || fcntl(fd, F_ADD_SEALS, F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+#endif
+
+std::shared_ptr<const ArenaRom> RomArena::add(const RomImage& rom) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_roms.find(rom.hash());
+    if (it != m_roms.end()) {
+        if (auto existing = it->second.lock())
+            return existing;
+    }
+
+    int fd = -1;
+#ifdef __linux__
+    // Without a memfd the VMs still run, each on its own copy
+    fd = create_memfd(rom);
+    if (fd < 0)
+        fprintf(stderr, "Failed to create ROM arena file; VMs will not share pages\n");
+#endif
+    auto added = std::make_shared<const ArenaRom>(fd, rom.hash(), rom.image(), rom.image_size());
+    m_roms[rom.hash()] = added;
+    return added;
+}
+
+size_t RomArena::size() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_roms.begin(); it != m_roms.end();) {
+        if (it->second.expired())
+            it = m_roms.erase(it);
+        else
+            ++it;
+    }
+    return m_roms.size();
+}
+
+void VmMemory::release() {
+    if (m_storage == Storage::Heap)
+        delete[] m_data;
+#ifdef __linux__
+    else if (m_storage == Storage::Mapped)
+        munmap(m_data, m_size);
+#endif
+    m_data = m_inline;
+    m_storage = Storage::Inline;
+}
+
+void VmMemory::allocate(size_t size) {
+    release();
+    if (size > VM_MEMORY_SIZE) {
+        m_data = new uint8_t[size];
+        m_storage = Storage::Heap;
+    }
+    m_size = size;
+}
+
+void VmMemory::take(VmMemory& other) {
+    m_size = other.m_size;
+    m_storage = other.m_storage;
+    if (other.m_storage == Storage::Inline) {
+        m_data = m_inline;
+        memcpy(m_inline, other.m_inline, m_size);
+    } else {
+        m_data = other.m_data;
+    }
+    other.m_data = other.m_inline;
+    other.m_storage = Storage::Inline;
+    other.m_size = VM_MEMORY_SIZE;
+}
+
+VmMemory::VmMemory(const VmMemory& other) : m_data(m_inline) {
+    allocate(other.m_size);
+    memcpy(m_data, other.m_data, m_size);
+}
+
+VmMemory::VmMemory(VmMemory&& other) noexcept {
+    take(other);
+}
+
+VmMemory& VmMemory::operator=(const VmMemory& other) {
+    if (this == &other)
+        return *this;
+    // A copy is always private, even of a VM that shares the arena's pages
+    if (m_size != other.m_size || m_storage == Storage::Mapped)
+        allocate(other.m_size);
+    memcpy(m_data, other.m_data, m_size);
+    return *this;
+}
+
+VmMemory& VmMemory::operator=(VmMemory&& other) noexcept {
+    if (this != &other) {
+        release();
+        take(other);
+    }
+    return *this;
+}
+
+void VmMemory::resize(size_t size) {
+    if (size == m_size)
+        return;
+    VmMemory old(std::move(*this));
+    allocate(size);
+    size_t keep = std::min(size, old.m_size);
+    memcpy(m_data, old.m_data, keep);
+    memset(m_data + keep, 0, size - keep);
+}
+
+#ifdef __linux__
+static size_t page_size() {
+    static const size_t size = sysconf(_SC_PAGESIZE);
+    return size;
+}
+#endif
+
+void VmMemory::attach(const ArenaRom& rom) {
+#ifdef __linux__
+    if (rom.fd() >= 0 && rom.size() == m_size && m_size % page_size() == 0) {
+        void* pages = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, rom.fd(), 0);
+        if (pages != MAP_FAILED) {
+            release();
+            m_data = (uint8_t*) pages;
+            m_storage = Storage::Mapped;
+            return;
+        }
+    }
+#endif
+    // Out of mappings, no memfd, or an image for another variant: same
+    // contents, just not shared
+    if (m_storage == Storage::Mapped)
+        allocate(m_size);
+    size_t size = std::min(rom.size(), m_size);
+    memcpy(m_data, rom.data(), size);
+    memset(m_data + size, 0, m_size - size);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/*
+  Shared ROM arena.
+
+  A VM's memory (VmMemory) is a plain private buffer: 4KB held inline, or
+  64KB on the heap for XO-CHIP, so constructing, copying and moving a VM
+  costs no system calls. Classic VMs never pay for the larger size.
+
+  On Linux, a VM attached to an ArenaRom instead maps that ROM's sealed
+  memfd MAP_PRIVATE: all VMs running the ROM share the physical pages until
+  they write to them, when the kernel gives the writer its own copy. With
+  4KB pages CHIP-8 memory is exactly one page, so the dirty overlay is
+  all-or-nothing; a VM that never writes RAM (no FX33/FX55) stays shared for
+  good, and re-attaching drops the private copy. Memory that is not a whole
+  number of pages (4KB VMs on a 16KB-page system) is not worth mapping, and
+  like every platform without memfd it gets a private copy of the image on
+  attach instead.
+
+  Each mapping is one kernel VMA, so very large session counts may need a
+  higher vm.max_map_count (65530 by default).
+*/
+
+#define VM_MEMORY_SIZE 4096
+#define XO_MEMORY_SIZE 65536
+
+class RomImage;
+
+class ArenaRom {
+public:
+    ArenaRom(int fd, uint64_t hash, const uint8_t* image, size_t size)
+        : m_fd(fd), m_hash(hash), m_image(image, image + size) {}
+    ~ArenaRom();
+    ArenaRom(const ArenaRom&) = delete;
+    ArenaRom& operator=(const ArenaRom&) = delete;
+    int fd() const { return m_fd; }  // sealed memfd, -1 where there is none
+    uint64_t hash() const { return m_hash; }
+    const uint8_t* data() const { return m_image.data(); }
+    size_t size() const { return m_image.size(); }
+
+private:
+    int m_fd;
+    uint64_t m_hash;
+    std::vector<uint8_t> m_image;  // for VMs that copy instead of mapping
+};
+
+class RomArena {
+public:
+    // One ArenaRom per distinct ROM hash while anyone holds it
+    std::shared_ptr<const ArenaRom> add(const RomImage& rom);
+    size_t size();  // distinct ROMs still referenced
+
+private:
+    std::mutex m_mutex;
+    std::map<uint64_t, std::weak_ptr<const ArenaRom>> m_roms;
+};
+
+class VmMemory {
+public:
+    VmMemory() : m_data(m_inline) {}
+    VmMemory(const VmMemory& other);
+    VmMemory(VmMemory&& other) noexcept;
+    VmMemory& operator=(const VmMemory& other);
+    VmMemory& operator=(VmMemory&& other) noexcept;
+    ~VmMemory() { release(); }
+
+    void attach(const ArenaRom& rom);  // copy-on-write view of rom; discards local writes
+    void resize(size_t size);          // keeps the first min(old, new) bytes, zeroes the rest
+    size_t size() const { return m_size; }
+    bool shared() const { return m_storage == Storage::Mapped; }
+
+    uint8_t& operator[](size_t i) { return m_data[i]; }
+    const uint8_t& operator[](size_t i) const { return m_data[i]; }
+    operator uint8_t*() { return m_data; }
+    operator const uint8_t*() const { return m_data; }
+
+private:
+    enum class Storage : uint8_t {
+        Inline,  // m_inline, for sizes up to VM_MEMORY_SIZE
+        Heap,
+        Mapped,  // an ArenaRom's memfd, MAP_PRIVATE
+    };
+    void release();              // frees heap or mapped storage; m_data goes back to m_inline
+    void allocate(size_t size);  // private storage for size bytes, contents undefined
+    void take(VmMemory& other);  // other's storage; other is left empty and inline
+
+    uint8_t* m_data;
+    size_t m_size = VM_MEMORY_SIZE;
+    Storage m_storage = Storage::Inline;
+    uint8_t m_inline[VM_MEMORY_SIZE] = {};
+};
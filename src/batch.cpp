@@ -0,0 +1,204 @@
+#include "batch.hpp"
+#include "oracle.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+// Default run length: ten seconds of emulated time
+#define DEFAULT_FRAMES 600
+
+static std::string json_escape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char) c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+static void record_trap(BatchResult& result, const Chip8& vm) {
+    if (vm.trapped) {
+        result.trapped = true;
+        result.trap = vm.fault;
+        result.trap_pc = vm.fault_pc;
+        result.trap_opcode = vm.fault_opcode;
+    }
+    result.gfx_hash = vm.gfx_hash();
+}
+
+// Reference and candidate in lockstep, compared after every instruction; false
+// if the candidate does not implement the ROM's variant
+static bool run_oracle(const RomImage& rom, const RomProfile& profile, long budget, const char* oracle,
+                       BatchResult& result) {
+    ReferenceEngine reference;
+    std::unique_ptr<Engine> candidate = make_engine(oracle);
+    Oracle check(reference, *candidate);
+    auto start = std::chrono::steady_clock::now();
+    bool loaded = check.load(rom, 0, profile);
+    result.oracle_report = check.report();
+    if (check.unsupported())
+        return false;
+    result.oracle_checked = true;
+    result.diverged = !loaded || !check.run(budget);
+    auto end = std::chrono::steady_clock::now();
+    result.oracle_report = check.report();
+
+    Chip8& vm = reference.vm;
+    result.instructions = check.steps() - (vm.trapped ? 1 : 0);
+    result.frames = result.instructions / vm.cycles_per_frame;
+    result.wall_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    record_trap(result, vm);
+    return true;
+}
+
+BatchResult run_rom(const std::string& path, long max_frames, long max_instructions, const char* oracle,
+                    const RomDb* db) {
+    BatchResult result = {};
+    result.rom = std::filesystem::path(path).filename().string();
+
+    RomImage rom;
+    if (!rom.open(path.c_str())) {
+        return result;
+    }
+    result.loaded = true;
+    const RomProfile* found = db != NULL ? db->find(rom.hash()) : NULL;
+    RomProfile profile = found != NULL ? *found : RomProfile();
+
+    if (oracle != NULL) {
+        // The same window the unchecked run would cover at the profile's clock
+        int cycles_per_frame = profile.cycles_per_frame > 0 ? profile.cycles_per_frame : CYCLES_PER_FRAME;
+        long budget = max_instructions > 0 ? max_instructions : max_frames * cycles_per_frame;
+        if (run_oracle(rom, profile, budget, oracle, result))
+            return result;
+        // Not something the candidate implements; the ROM still runs, unchecked
+    }
+
+    Chip8 vm = Chip8(false);
+    vm.init();
+    vm.load_rom(rom);
+    vm.set_profile(profile);
+
+    auto start = std::chrono::steady_clock::now();
+    if (max_instructions > 0) {
+        // Only completed instructions count. Batch runs never press a key,
+        // so an FX0A wait would never end and stops the run like a trap
+        while (result.instructions < max_instructions) {
+            if (vm.emulate_cycle() != Status::Ok)
+                break;
+            result.instructions++;
+        }
+        result.frames = result.instructions / vm.cycles_per_frame;
+    } else {
+        while (result.frames < max_frames && !vm.trapped) {
+            result.instructions += vm.emulate_frame();
+            result.frames++;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    result.wall_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    record_trap(result, vm);
+    return result;
+}
+
+static void print_result(const BatchResult& r) {
+    if (!r.loaded) {
+        printf("{\"rom\":\"%s\",\"error\":\"unreadable or larger than %d bytes\"}\n",
+               json_escape(r.rom).c_str(), MAX_XO_ROM_SIZE);
+        return;
+    }
+    double mips = r.wall_ms > 0 ? r.instructions / (r.wall_ms * 1000.0) : 0.0;
+    printf("{\"rom\":\"%s\",\"instructions\":%ld,\"frames\":%ld,\"wall_ms\":%.3f,\"mips\":%.2f,"
+           "\"gfx_hash\":\"%016llx\",\"trapped\":%s",
+           json_escape(r.rom).c_str(), r.instructions, r.frames, r.wall_ms, mips,
+           (unsigned long long) r.gfx_hash, r.trapped ? "true" : "false");
+    if (r.trapped) {
+        printf(",\"trap\":\"%s\",\"trap_pc\":\"0x%03X\",\"trap_opcode\":\"0x%04X\"",
+               status_name(r.trap), r.trap_pc, r.trap_opcode);
+    }
+    if (r.oracle_checked) {
+        printf(",\"oracle\":\"%s\"", r.diverged ? "diverged" : "match");
+        if (r.diverged)
+            printf(",\"oracle_report\":\"%s\"", json_escape(r.oracle_report).c_str());
+    } else if (!r.oracle_report.empty()) {
+        printf(",\"oracle\":\"unsupported\",\"oracle_report\":\"%s\"", json_escape(r.oracle_report).c_str());
+    }
+    printf("}\n");
+}
+
+int batch(int argc, char** argv) {
+    long frames = DEFAULT_FRAMES;
+    long instructions = 0;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    const char* dir = NULL;
+    const char* oracle = NULL;
+    const char* romdb = NULL;
+
+    for (int i = 0; i < argc; i++) {
+        if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--instructions") && i + 1 < argc) {
+            instructions = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            threads = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--oracle") && i + 1 < argc) {
+            oracle = argv[++i];
+            if (make_engine(oracle) == nullptr) {
+                fprintf(stderr, "Unknown engine %s; choose reference or batch\n", oracle);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--romdb") && i + 1 < argc) {
+            romdb = argv[++i];
+        } else {
+            dir = argv[i];
+        }
+    }
+    if (dir == NULL) {
+        fprintf(stderr, "Usage: ./chip8 batch [--frames N | --instructions N] [-j THREADS] [--oracle ENGINE] [--romdb PATH] <ROM directory>\n");
+        return 1;
+    }
+    // Loaded once and shared read-only by the workers
+    RomDb db;
+    const char* db_path = romdb_path(romdb);
+    if (db_path != NULL && !db.load(db_path)) {
+        return 1;
+    }
+
+    std::vector<std::string> roms;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        if (entry.is_regular_file()) {
+            roms.push_back(entry.path().string());
+        }
+    }
+    if (ec) {
+        fprintf(stderr, "Failed to read directory %s: %s\n", dir, ec.message().c_str());
+        return 1;
+    }
+    std::sort(roms.begin(), roms.end());
+
+    std::vector<BatchResult> results(roms.size());
+    parallel_for(roms.size(), threads, [&](size_t i) {
+        results[i] = run_rom(roms[i], frames, instructions, oracle, db_path != NULL ? &db : NULL);
+    });
+
+    int failures = 0;
+    for (const auto& r : results) {
+        print_result(r);
+        if (!r.loaded || r.trapped || r.diverged)
+            failures++;
+    }
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+
+#include "chip8.hpp"
+
+/*
+  Headless batch runner: runs every ROM in a directory on a thread pool and
+  writes one JSON line per ROM to stdout.
+
+  Usage: ./chip8 batch [--frames N | --instructions N] [-j THREADS] [--oracle ENGINE] [--romdb PATH] <ROM directory>
+
+  Each ROM runs with the variant it needs and, with --romdb or CHIP8_ROMDB,
+  the quirks and cycle count of its database profile.
+
+  --oracle runs each ROM on the reference interpreter and ENGINE in lockstep
+  (see oracle.hpp) and fails any ROM where they diverge. A ROM whose variant
+  ENGINE does not implement runs unchecked and is reported as unsupported.
+*/
+
+struct BatchResult {
+    std::string rom;
+    bool loaded;
+    long instructions;
+    long frames;
+    double wall_ms;
+    uint64_t gfx_hash;
+    bool trapped;
+    Status trap;
+    uint16_t trap_pc;
+    uint16_t trap_opcode;
+    bool oracle_checked;   // false with a report when the engine does not support the ROM
+    bool diverged;
+    std::string oracle_report;
+};
+
+int batch(int argc, char** argv);
+BatchResult run_rom(const std::string& path, long max_frames, long max_instructions, const char* oracle = NULL,
+                    const RomDb* db = NULL);
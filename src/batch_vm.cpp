@@ -0,0 +1,502 @@
+#include "batch_vm.hpp"
+#include "rng.hpp"
+
+#include <algorithm>
+
+// Widen a 0x00/0xFF lane mask to 16 bits
+static inline uint16_t wide(uint8_t m) {
+    return (uint16_t) (int16_t) (int8_t) m;
+}
+
+static inline uint8_t blend(uint8_t old_value, uint8_t new_value, uint8_t m) {
+    return (old_value & ~m) | (new_value & m);
+}
+
+BatchChip8::BatchChip8(int lanes) {
+    m_lanes = lanes;
+    m_stride = (lanes + LANE_PAD - 1) / LANE_PAD * LANE_PAD;
+
+    for (int r = 0; r < 16; r++) {
+        V[r].assign(m_stride, 0);
+    }
+    I.assign(m_stride, 0);
+    pc.assign(m_stride, 0);
+    sp.assign(m_stride, 0);
+    delay_timer.assign(m_stride, 0);
+    sound_timer.assign(m_stride, 0);
+    draw_flag.assign(m_stride, 0);
+    trapped.assign(m_stride, 0);
+    fault.assign(m_stride, 0);
+    faults.assign(m_stride, 0);
+
+    memory.assign(4096 * m_stride, 0);
+    stack.assign(lanes * 16, 0);
+    gfx.assign(lanes * 64*32, 0);
+    key.assign(lanes * 16, 0);
+    rng.assign(lanes * 4, 0);
+    for (int l = 0; l < lanes; l++) {
+        seed(l, 0);
+    }
+
+    m_active.assign(m_stride, 0);
+    m_opcode.assign(m_stride, 0);
+    m_mask.assign(m_stride, 0);
+    m_tick.assign(m_stride, 0);
+    m_done.assign(m_stride, 0);
+}
+
+void BatchChip8::init() {
+    for (int r = 0; r < 16; r++) {
+        std::fill(V[r].begin(), V[r].end(), 0);
+    }
+    std::fill(I.begin(), I.end(), 0);
+    std::fill(pc.begin(), pc.end(), 0x200);
+    std::fill(sp.begin(), sp.end(), 0);
+    std::fill(delay_timer.begin(), delay_timer.end(), 0);
+    std::fill(sound_timer.begin(), sound_timer.end(), 0);
+    std::fill(draw_flag.begin(), draw_flag.end(), 0);
+    std::fill(fault.begin(), fault.end(), 0);
+    std::fill(faults.begin(), faults.end(), 0);
+    for (int l = 0; l < m_stride; l++) {
+        trapped[l] = l >= m_lanes;
+        m_active[l] = trapped[l] ? 0x00 : 0xFF;
+    }
+
+    std::fill(memory.begin(), memory.end(), 0);
+    std::fill(stack.begin(), stack.end(), 0);
+    std::fill(gfx.begin(), gfx.end(), 0);
+    std::fill(key.begin(), key.end(), 0);
+    // Both font sets, so memory matches Chip8::init() byte for byte
+    uint8_t fonts[0x200] = {};
+    load_fonts(fonts);
+    for (int i = 0; i < 0x200; i++) {
+        memset(&memory[i * m_stride], fonts[i], m_lanes);
+    }
+}
+
+bool BatchChip8::load(const unsigned char* data, long data_size) {
+    if (data_size < 0 || data_size > MAX_ROM_SIZE)
+        return false;
+    for (int i = 0; i < data_size; i++) {
+        memset(&memory[(i + 512) * m_stride], data[i], m_lanes);
+    }
+    return true;
+}
+
+void BatchChip8::set_key(int lane, int i, bool value) {
+    key[lane * 16 + i] = value;
+}
+
+void BatchChip8::seed(int lane, uint64_t seed) {
+    rng_seed(&rng[lane * 4], seed);
+}
+
+void BatchChip8::step() {
+    const int n = m_stride;
+    const uint8_t* __restrict active = m_active.data();
+    const uint16_t* __restrict p = pc.data();
+
+    int first = 0;
+    while (first < m_lanes && trapped[first])
+        first++;
+    if (first == m_lanes)
+        return;
+
+    // Lockstep fast path: every running lane on the same pc with the same opcode bytes
+    uint16_t pc0 = p[first];
+    if (pc0 > 0xFFE) {
+        // Fault those lanes, then step the rest
+        trap_range();
+        step();
+        return;
+    }
+    const uint8_t* hi = &memory[pc0 * n];
+    const uint8_t* lo = &memory[(pc0 + 1) * n];
+    uint16_t diff = 0;
+    for (int l = 0; l < n; l++) {
+        diff |= ((p[l] ^ pc0) | (hi[l] ^ hi[first]) | (lo[l] ^ lo[first])) & wide(active[l]);
+    }
+    if (diff == 0) {
+        execute(hi[first] << 8 | lo[first], active);
+        return;
+    }
+
+    // Divergent lanes: one masked pass per distinct opcode
+    trap_range();
+    uint16_t* op = m_opcode.data();
+    for (int l = 0; l < m_lanes; l++) {
+        op[l] = mem(l, p[l] & 0xFFF) << 8 | mem(l, (p[l] + 1) & 0xFFF);
+    }
+    for (int l = 0; l < n; l++) {
+        m_done[l] = trapped[l];
+    }
+    for (int l = 0; l < m_lanes; l++) {
+        if (m_done[l])
+            continue;
+        uint16_t opcode = op[l];
+        for (int k = 0; k < n; k++) {
+            m_mask[k] = (!m_done[k] && op[k] == opcode) ? 0xFF : 0x00;
+            m_done[k] |= m_mask[k] & 1;
+        }
+        execute(opcode, m_mask.data());
+    }
+}
+
+void BatchChip8::trap_lane(int lane, Status status) {
+    // Faults trap one lane; it stays on the instruction and its timers stop
+    trapped[lane] = 1;
+    fault[lane] = (uint8_t) status;
+    m_active[lane] = 0x00;
+    m_tick[lane] = 0;
+}
+
+void BatchChip8::trap_range() {
+    // Lanes whose pc ran off the end of memory fault before fetching
+    for (int l = 0; l < m_lanes; l++) {
+        if (!trapped[l] && pc[l] > 0xFFE)
+            trap_lane(l, Status::MemoryOutOfRange);
+    }
+}
+
+void BatchChip8::execute(uint16_t opcode, const uint8_t* m) {
+    const int n = m_stride;
+    const uint8_t x = (opcode & 0x0F00) >> 8;
+    const uint8_t y = (opcode & 0x00F0) >> 4;
+    const uint8_t nn = opcode & 0x00FF;
+    const uint16_t nnn = opcode & 0x0FFF;
+
+    uint16_t* __restrict p = pc.data();
+    const uint8_t* tick = m;
+    uint8_t* vx = V[x].data();
+    uint8_t* vy = V[y].data();
+    uint8_t* vf = V[0xF].data();
+    bool illegal = false;
+
+    switch (opcode & 0xF000) {
+    case(0x0000):
+        if (nn == 0xE0) {
+            // 00E0: Clear the screen
+            for (int l = 0; l < m_lanes; l++) {
+                if (m[l])
+                    memset(lane_gfx(l), 0, 64*32);
+            }
+            for (int l = 0; l < n; l++) {
+                draw_flag[l] |= m[l] & 1;
+                p[l] += 2 & wide(m[l]);
+            }
+        } else if (nn == 0xEE) {
+            // 00EE: Return from a subroutine
+            memcpy(m_tick.data(), m, n);
+            tick = m_tick.data();
+            for (int l = 0; l < m_lanes; l++) {
+                if (!m[l])
+                    continue;
+                if (sp[l] == 0) {
+                    trap_lane(l, Status::StackUnderflow);
+                    continue;
+                }
+                sp[l]--;
+                p[l] = stack[l * 16 + sp[l]] + 2;
+            }
+        } else {
+            illegal = true;
+        }
+        break;
+    case(0x1000):
+        // 1NNN: jumps to address NNN
+        for (int l = 0; l < n; l++) {
+            p[l] = (p[l] & ~wide(m[l])) | (nnn & wide(m[l]));
+        }
+        break;
+    case(0x2000):
+        // 2NNN: Call subroutine at NNN
+        memcpy(m_tick.data(), m, n);
+        tick = m_tick.data();
+        for (int l = 0; l < m_lanes; l++) {
+            if (!m[l])
+                continue;
+            if (sp[l] == 16) {
+                trap_lane(l, Status::StackOverflow);
+                continue;
+            }
+            stack[l * 16 + sp[l]] = p[l];
+            sp[l]++;
+            p[l] = nnn;
+        }
+        break;
+    case(0x3000):
+        // 3XNN: Skips next instr if V[x] == NN
+        for (int l = 0; l < n; l++) {
+            p[l] += (vx[l] == nn ? 4 : 2) & wide(m[l]);
+        }
+        break;
+    case(0x4000):
+        // 4XNN: Skips next instr if V[x] != NN
+        for (int l = 0; l < n; l++) {
+            p[l] += (vx[l] != nn ? 4 : 2) & wide(m[l]);
+        }
+        break;
+    case(0x5000):
+        // 5XY0: Skips next instr if V[x] == V[y]
+        if ((opcode & 0x000F) != 0) {
+            illegal = true;
+            break;
+        }
+        for (int l = 0; l < n; l++) {
+            p[l] += (vx[l] == vy[l] ? 4 : 2) & wide(m[l]);
+        }
+        break;
+    case(0x6000):
+        // 6XNN: Sets V[x] to NN
+        for (int l = 0; l < n; l++) {
+            vx[l] = blend(vx[l], nn, m[l]);
+            p[l] += 2 & wide(m[l]);
+        }
+        break;
+    case(0x7000):
+        // 7XNN: Adds NN into V[x] (carry flag is not changed)
+        for (int l = 0; l < n; l++) {
+            vx[l] += nn & m[l];
+            p[l] += 2 & wide(m[l]);
+        }
+        break;
+    case(0x8000):
+        // Per-lane order of VF and VX writes matches emulate_cycle when X or Y is F
+        switch (opcode & 0x000F) {
+        case(0x0000):
+            for (int l = 0; l < n; l++)
+                vx[l] = blend(vx[l], vy[l], m[l]);
+            break;
+        case(0x0001):
+            for (int l = 0; l < n; l++)
+                vx[l] = blend(vx[l], vx[l] | vy[l], m[l]);
+            break;
+        case(0x0002):
+            for (int l = 0; l < n; l++)
+                vx[l] = blend(vx[l], vx[l] & vy[l], m[l]);
+            break;
+        case(0x0003):
+            for (int l = 0; l < n; l++)
+                vx[l] = blend(vx[l], vx[l] ^ vy[l], m[l]);
+            break;
+        case(0x0004):
+            for (int l = 0; l < n; l++) {
+                vf[l] = blend(vf[l], vx[l] > (0xFF - vy[l]) ? 1 : 0, m[l]);
+                vx[l] = blend(vx[l], vx[l] + vy[l], m[l]);
+            }
+            break;
+        case(0x0005):
+            for (int l = 0; l < n; l++) {
+                vf[l] = blend(vf[l], vy[l] > vx[l] ? 0 : 1, m[l]);
+                vx[l] = blend(vx[l], vx[l] - vy[l], m[l]);
+            }
+            break;
+        case(0x0006): {
+            // shift_vy quirk: the source is VY; it is read after VF is written, as in emulate_cycle
+            const uint8_t* src = quirks.shift_vy ? vy : vx;
+            for (int l = 0; l < n; l++) {
+                vf[l] = blend(vf[l], src[l] & 1, m[l]);
+                vx[l] = blend(vx[l], src[l] >> 1, m[l]);
+            }
+        }
+            break;
+        case(0x0007):
+            for (int l = 0; l < n; l++) {
+                vf[l] = blend(vf[l], vx[l] > vy[l] ? 0 : 1, m[l]);
+                vx[l] = blend(vx[l], vy[l] - vx[l], m[l]);
+            }
+            break;
+        case(0x000E): {
+            const uint8_t* src = quirks.shift_vy ? vy : vx;
+            for (int l = 0; l < n; l++) {
+                vf[l] = blend(vf[l], src[l] >> 7, m[l]);
+                vx[l] = blend(vx[l], src[l] << 1, m[l]);
+            }
+        }
+            break;
+        default:
+            illegal = true;
+        }
+        if (!illegal) {
+            for (int l = 0; l < n; l++)
+                p[l] += 2 & wide(m[l]);
+        }
+        break;
+    case(0x9000):
+        // 9XY0: skips next instr if VX != VY
+        for (int l = 0; l < n; l++) {
+            p[l] += (vx[l] != vy[l] ? 4 : 2) & wide(m[l]);
+        }
+        break;
+    case(0xA000):
+        // ANNN: Sets I to address NNN
+        for (int l = 0; l < n; l++) {
+            I[l] = (I[l] & ~wide(m[l])) | (nnn & wide(m[l]));
+            p[l] += 2 & wide(m[l]);
+        }
+        break;
+    case(0xB000):
+        // BNNN: jumps to address NNN + V0
+        for (int l = 0; l < n; l++) {
+            p[l] = (p[l] & ~wide(m[l])) | ((nnn + V[0][l]) & wide(m[l]));
+        }
+        break;
+    case(0xC000):
+        // CXNN: VX = random byte & NN
+        for (int l = 0; l < m_lanes; l++) {
+            if (!m[l])
+                continue;
+            vx[l] = nn & (rng_next(&rng[l * 4]) >> 24);
+            p[l] += 2;
+        }
+        break;
+    case(0xD000): {
+        // DXYN: Draw sprite
+        uint8_t height = opcode & 0x000F;
+        for (int l = 0; l < m_lanes; l++) {
+            if (!m[l])
+                continue;
+            uint8_t* screen = lane_gfx(l);
+            uint8_t px = vx[l];
+            uint8_t py = vy[l];
+            uint8_t collision = 0;
+            for (int dy = 0; dy < height; dy++) {
+                uint8_t pixel = mem(l, (I[l] + dy) & 0xFFF);
+                for (int dx = 0; dx < 8; dx++) {
+                    if ((pixel & (0x80 >> dx)) != 0) {
+                        uint16_t idx = (px + dx + ((py + dy) * 64)) & (64*32 - 1);
+                        collision |= screen[idx];
+                        screen[idx] ^= 1;
+                    }
+                }
+            }
+            vf[l] = collision;
+            faults[l] |= (I[l] + height - 1 > 0xFFF) * FAULT_READ_WRAP;
+            draw_flag[l] = 1;
+            p[l] += 2;
+        }
+    }
+        break;
+    case(0xE000):
+        if (nn == 0x9E || nn == 0xA1) {
+            // EX9E / EXA1: Skips the next instruction if key[V[X]] is / is not pressed
+            uint8_t want = nn == 0x9E;
+            for (int l = 0; l < m_lanes; l++) {
+                uint8_t pressed = key[l * 16 + (vx[l] & 0xF)] != 0;
+                p[l] += ((pressed == want) ? 4 : 2) & wide(m[l]);
+            }
+        } else {
+            illegal = true;
+        }
+        break;
+    case(0xF000):
+        switch (nn) {
+        case(0x07):
+            for (int l = 0; l < n; l++) {
+                vx[l] = blend(vx[l], delay_timer[l], m[l]);
+                p[l] += 2 & wide(m[l]);
+            }
+            break;
+        case(0x0A):
+            // FX0A: block until keypress; waiting lanes neither advance nor tick
+            memcpy(m_tick.data(), m, n);
+            tick = m_tick.data();
+            for (int l = 0; l < m_lanes; l++) {
+                if (!m[l])
+                    continue;
+                bool key_pressed = false;
+                for (int i = 0; i < 16; i++) {
+                    if (key[l * 16 + i] != 0) {
+                        vx[l] = i;
+                        key_pressed = true;
+                    }
+                }
+                if (key_pressed)
+                    p[l] += 2;
+                else
+                    m_tick[l] = 0;
+            }
+            break;
+        case(0x15):
+            for (int l = 0; l < n; l++) {
+                delay_timer[l] = blend(delay_timer[l], vx[l], m[l]);
+                p[l] += 2 & wide(m[l]);
+            }
+            break;
+        case(0x18):
+            for (int l = 0; l < n; l++) {
+                sound_timer[l] = blend(sound_timer[l], vx[l], m[l]);
+                p[l] += 2 & wide(m[l]);
+            }
+            break;
+        case(0x1E):
+            for (int l = 0; l < n; l++) {
+                I[l] += vx[l] & wide(m[l]);
+                p[l] += 2 & wide(m[l]);
+            }
+            break;
+        case(0x29):
+            for (int l = 0; l < n; l++) {
+                I[l] = (I[l] & ~wide(m[l])) | ((vx[l] * 5) & wide(m[l]));
+                p[l] += 2 & wide(m[l]);
+            }
+            break;
+        case(0x33):
+            for (int l = 0; l < m_lanes; l++) {
+                if (!m[l])
+                    continue;
+                mem(l, I[l] & 0xFFF) = vx[l] / 100;
+                mem(l, (I[l] + 1) & 0xFFF) = (vx[l] % 100) / 10;
+                mem(l, (I[l] + 2) & 0xFFF) = vx[l] % 10;
+                faults[l] |= (I[l] + 2 > 0xFFF) * FAULT_WRITE_WRAP;
+                p[l] += 2;
+            }
+            break;
+        case(0x55):
+            for (int l = 0; l < m_lanes; l++) {
+                if (!m[l])
+                    continue;
+                for (int i = 0; i <= x; i++) {
+                    mem(l, (I[l] + i) & 0xFFF) = V[i][l];
+                }
+                faults[l] |= (I[l] + x > 0xFFF) * FAULT_WRITE_WRAP;
+                if (quirks.load_store_inc)
+                    I[l] += x + 1;
+                p[l] += 2;
+            }
+            break;
+        case(0x65):
+            for (int l = 0; l < m_lanes; l++) {
+                if (!m[l])
+                    continue;
+                for (int i = 0; i <= x; i++) {
+                    V[i][l] = mem(l, (I[l] + i) & 0xFFF);
+                }
+                faults[l] |= (I[l] + x > 0xFFF) * FAULT_READ_WRAP;
+                if (quirks.load_store_inc)
+                    I[l] += x + 1;
+                p[l] += 2;
+            }
+            break;
+        default:
+            illegal = true;
+        }
+        break;
+    }
+
+    if (illegal) {
+        // Trapped lanes stay on the faulting instruction
+        for (int l = 0; l < m_lanes; l++) {
+            if (m[l])
+                trap_lane(l, Status::IllegalOpcode);
+        }
+        return;
+    }
+
+    uint8_t* __restrict dt = delay_timer.data();
+    uint8_t* __restrict st = sound_timer.data();
+    for (int l = 0; l < n; l++) {
+        dt[l] -= (dt[l] != 0) & tick[l];
+        st[l] -= (st[l] != 0) & tick[l];
+    }
+}
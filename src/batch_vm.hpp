@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+
+#include "chip8.hpp"
+
+/*
+  Lockstep batch interpreter.
+
+  Holds N copies of the VM in structure-of-arrays form: V[r][lane], I[lane],
+  pc[lane], and memory[addr][lane], so the bytes every lane would fetch at the
+  same pc are contiguous. When all running lanes are on the same instruction it
+  is decoded once and applied to every lane in one pass of branchless masked
+  loops the compiler can vectorize (build with -O3 -march=native to get
+  AVX2/AVX-512 lanes). Divergent lanes are regrouped by opcode and each group
+  runs as its own masked pass.
+
+  Lane arrays are padded to a multiple of LANE_PAD so vector loops have no
+  scalar tail; padding lanes are permanently trapped.
+
+  Only plain CHIP-8 is implemented (4KB memory, 64x32 display), with the
+  quirks shared by every lane and the FAULT_* wrap bits kept per lane as in
+  Chip8.
+*/
+
+#define LANE_PAD 64
+
+class BatchChip8 {
+public:
+    BatchChip8(int lanes);
+    void init();
+    bool load(const unsigned char* data, long data_size);
+    void step();
+    void set_key(int lane, int i, bool value);
+    void seed(int lane, uint64_t seed);  // same stream as Chip8::seed
+    int lanes() const { return m_lanes; }
+
+    uint8_t& mem(int lane, int addr) { return memory[addr * m_stride + lane]; }
+    uint8_t* lane_gfx(int lane) { return &gfx[lane * 64*32]; }
+
+    std::vector<uint8_t> V[16];        // V[r][lane]
+    std::vector<uint16_t> I;
+    std::vector<uint16_t> pc;
+    std::vector<uint16_t> sp;
+    std::vector<uint8_t> delay_timer;
+    std::vector<uint8_t> sound_timer;
+    std::vector<uint8_t> draw_flag;
+    std::vector<uint8_t> trapped;
+    std::vector<uint8_t> fault;        // Status that trapped the lane
+    std::vector<uint8_t> faults;       // FAULT_* bits seen since init()
+    Quirks quirks;                     // for every lane, kept across init()
+
+    std::vector<uint8_t> memory;       // memory[addr][lane], see mem()
+    std::vector<uint16_t> stack;       // 16 entries per lane
+    std::vector<uint8_t> gfx;          // 64*32 pixels per lane
+    std::vector<uint8_t> key;          // 16 keys per lane
+    std::vector<uint32_t> rng;         // 4 words of xoshiro128++ state per lane
+
+private:
+    void execute(uint16_t opcode, const uint8_t* mask);
+    void trap_lane(int lane, Status status);
+    void trap_range();
+
+    int m_lanes;
+    int m_stride;
+    std::vector<uint8_t> m_active;     // 0xFF for lanes that have not trapped
+    std::vector<uint16_t> m_opcode;    // fetched opcode per lane when lanes diverge
+    std::vector<uint8_t> m_mask;       // 0xFF for lanes in the current group
+    std::vector<uint8_t> m_tick;       // lanes whose timers tick after FX0A
+    std::vector<uint8_t> m_done;       // lanes already executed this step
+};
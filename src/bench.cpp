@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "chip8.hpp"
+
+/*
+  chip8_bench: repeatable micro and macro benchmarks.
+
+  Usage: ./chip8_bench [--filter SUBSTRING] [--rom PATH]... [--romdb PATH] [--out results.json]
+         ./chip8_bench --compare base.json new.json
+
+  Each benchmark runs REPEATS timed repetitions and reports the fastest, which
+  is the most repeatable figure on a shared machine. Results are JSON, one
+  benchmark per line.
+*/
+
+#define REPEATS 7
+#define MICRO_ITERATIONS 200000
+#define MACRO_INSTRUCTIONS 2000000
+
+struct BenchResult {
+    std::string name;
+    double ns_per_op;
+    long iterations;
+};
+
+static std::vector<BenchResult> results;
+static const char* filter = NULL;
+
+// Small public-domain programs so the macro benchmarks need no external files
+static const unsigned char rom_maze[] = {
+    // Random diagonal maze, after David Winter's MAZE
+    0xA2, 0x1A, 0xC2, 0x01, 0x32, 0x01, 0xA2, 0x1E, 0xD0, 0x14, 0x70, 0x04, 0x30, 0x40, 0x12, 0x00,
+    0x60, 0x00, 0x71, 0x04, 0x31, 0x20, 0x12, 0x00, 0x12, 0x18, 0x80, 0x40, 0x20, 0x10, 0x20, 0x40,
+    0x80, 0x10,
+};
+static const unsigned char rom_counter[] = {
+    // Clear, BCD-convert a counter and draw its three digits, forever
+    0x00, 0xE0, 0xA3, 0x00, 0xF3, 0x33, 0xF2, 0x65, 0x6A, 0x00, 0x6B, 0x00, 0xF0, 0x29, 0xDA, 0xB5,
+    0x7A, 0x05, 0xF1, 0x29, 0xDA, 0xB5, 0x7A, 0x05, 0xF2, 0x29, 0xDA, 0xB5, 0x73, 0x01, 0x12, 0x00,
+};
+static const unsigned char rom_alu[] = {
+    // Arithmetic and skip loop with no drawing
+    0x71, 0x01, 0x82, 0x14, 0x83, 0x26, 0x64, 0x05, 0x84, 0x34, 0x75, 0x01, 0x35, 0x00, 0x12, 0x00,
+    0x66, 0x00, 0x12, 0x00,
+};
+
+static bool selected(const std::string& name) {
+    return filter == NULL || name.find(filter) != std::string::npos;
+}
+
+static void record(const std::string& name, double best_ns, long iterations) {
+    results.push_back(BenchResult{name, best_ns / iterations, iterations});
+    fprintf(stderr, "%-24s %10.2f ns/op %12.0f ops/s\n", name.c_str(),
+            best_ns / iterations, iterations * 1e9 / best_ns);
+}
+
+// Time one instruction at 0x200; setup restores whatever the instruction consumed
+template <typename Setup>
+static void bench_op(const std::string& name, uint16_t opcode, Setup setup) {
+    if (!selected(name))
+        return;
+    Chip8 vm;
+    vm.init();
+    unsigned char rom[] = {(unsigned char) (opcode >> 8), (unsigned char) (opcode & 0xFF)};
+    vm.load(rom, 2);
+    for (int i = 0; i < 16; i++) {
+        vm.V[i] = i * 3;
+    }
+    vm.I = 0x300;
+
+    double best = 1e300;
+    for (int r = 0; r < REPEATS; r++) {
+        auto start = std::chrono::steady_clock::now();
+        for (long i = 0; i < MICRO_ITERATIONS; i++) {
+            vm.pc = 0x200;
+            setup(vm);
+            vm.emulate_cycle();
+        }
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count());
+    }
+    record(name, best, MICRO_ITERATIONS);
+}
+
+static void bench_op(const std::string& name, uint16_t opcode) {
+    bench_op(name, opcode, [](Chip8&) {});
+}
+
+static void bench_argb() {
+    if (!selected("gfx_to_argb"))
+        return;
+    Chip8 vm;
+    vm.init();
+    for (int i = 0; i < 64*32; i++) {
+        vm.gfx[i] = (i * 7) & 1;
+    }
+    uint32_t pixels[64*32];
+    const long iterations = MICRO_ITERATIONS / 10;
+    double best = 1e300;
+    for (int r = 0; r < REPEATS; r++) {
+        auto start = std::chrono::steady_clock::now();
+        for (long i = 0; i < iterations; i++) {
+            vm.to_argb(pixels);
+            vm.gfx[i & 2047] ^= pixels[(i * 31) & 2047] & 1;
+        }
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count());
+    }
+    record("gfx_to_argb", best, iterations);
+}
+
+static void bench_rom(const std::string& name, const RomImage& rom, const RomDb* db = NULL) {
+    if (!selected(name))
+        return;
+    double best = 1e300;
+    long executed = 0;
+    for (int r = 0; r < REPEATS; r++) {
+        Chip8 vm;
+        vm.init();
+        vm.load_rom(rom);
+        if (db != NULL)
+            configure_rom(vm, *db);
+        vm.seed(1);
+        executed = 0;
+        auto start = std::chrono::steady_clock::now();
+        while (executed < MACRO_INSTRUCTIONS && !vm.trapped) {
+            vm.emulate_cycle();
+            executed++;
+        }
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count());
+    }
+    record(name, best, executed);
+}
+
+static void run_micro() {
+    bench_op("00E0", 0x00E0);
+    bench_op("00EE", 0x00EE, [](Chip8& vm) { vm.sp = 1; vm.stack[0] = 0x1FE; });
+    bench_op("1NNN", 0x1200);
+    bench_op("2NNN", 0x2200, [](Chip8& vm) { vm.sp = 0; });
+    bench_op("3XNN", 0x3103);
+    bench_op("4XNN", 0x4103);
+    bench_op("5XY0", 0x5120);
+    bench_op("6XNN", 0x6142);
+    bench_op("7XNN", 0x7101);
+    bench_op("8XY0", 0x8120);
+    bench_op("8XY1", 0x8121);
+    bench_op("8XY2", 0x8122);
+    bench_op("8XY3", 0x8123);
+    bench_op("8XY4", 0x8124);
+    bench_op("8XY5", 0x8125);
+    bench_op("8XY6", 0x8126);
+    bench_op("8XY7", 0x8127);
+    bench_op("8XYE", 0x812E);
+    bench_op("9XY0", 0x9120);
+    bench_op("ANNN", 0xA300);
+    bench_op("BNNN", 0xB200, [](Chip8& vm) { vm.V[0] = 0; });
+    bench_op("CXNN", 0xC1FF);
+    // Sprite data comes from the font; the 15-row case reads three glyphs
+    bench_op("DXYN_h1", 0xD121, [](Chip8& vm) { vm.I = 0; });
+    bench_op("DXYN_h5", 0xD125, [](Chip8& vm) { vm.I = 0; });
+    bench_op("DXYN_h8", 0xD128, [](Chip8& vm) { vm.I = 0; });
+    bench_op("DXYN_h15", 0xD12F, [](Chip8& vm) { vm.I = 0; });
+    bench_op("EX9E", 0xE19E);
+    bench_op("EXA1", 0xE1A1);
+    bench_op("FX07", 0xF107);
+    bench_op("FX0A", 0xF10A, [](Chip8& vm) { vm.key[5] = 1; });
+    bench_op("FX15", 0xF115);
+    bench_op("FX18", 0xF118);
+    bench_op("FX1E", 0xF11E, [](Chip8& vm) { vm.I = 0x300; });
+    bench_op("FX29", 0xF129);
+    bench_op("FX33", 0xF133, [](Chip8& vm) { vm.I = 0x300; });
+    bench_op("FX55", 0xFF55, [](Chip8& vm) { vm.I = 0x300; });
+    bench_op("FX65", 0xFF65, [](Chip8& vm) { vm.I = 0x300; });
+    bench_argb();
+}
+
+static int write_results(const char* path) {
+    FILE* out = path ? fopen(path, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return 1;
+    }
+    fprintf(out, "{\"benchmarks\":[\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        fprintf(out, "{\"name\":\"%s\",\"ns_per_op\":%.4f,\"ops_per_sec\":%.0f,\"iterations\":%ld}%s\n",
+                r.name.c_str(), r.ns_per_op, 1e9 / r.ns_per_op, r.iterations,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "]}\n");
+    if (path)
+        fclose(out);
+    return 0;
+}
+
+static bool read_results(const char* path, std::vector<BenchResult>* out) {
+    std::ifstream file(path);
+    if (!file) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        char name[128];
+        BenchResult r;
+        if (sscanf(line.c_str(), "{\"name\":\"%127[^\"]\",\"ns_per_op\":%lf", name, &r.ns_per_op) == 2) {
+            r.name = name;
+            out->push_back(r);
+        }
+    }
+    return true;
+}
+
+static int compare(const char* base_path, const char* new_path) {
+    std::vector<BenchResult> base;
+    std::vector<BenchResult> current;
+    if (!read_results(base_path, &base) || !read_results(new_path, &current))
+        return 1;
+    printf("%-24s %12s %12s %9s\n", "benchmark", "base ns/op", "new ns/op", "change");
+    for (const auto& r : current) {
+        auto it = std::find_if(base.begin(), base.end(), [&](const BenchResult& b) { return b.name == r.name; });
+        if (it == base.end()) {
+            printf("%-24s %12s %12.2f %9s\n", r.name.c_str(), "-", r.ns_per_op, "new");
+            continue;
+        }
+        double change = (r.ns_per_op - it->ns_per_op) / it->ns_per_op * 100.0;
+        printf("%-24s %12.2f %12.2f %+8.1f%%\n", r.name.c_str(), it->ns_per_op, r.ns_per_op, change);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const char* out_path = NULL;
+    const char* romdb = NULL;
+    std::vector<std::string> rom_paths;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--compare") && i + 2 < argc) {
+            return compare(argv[i + 1], argv[i + 2]);
+        } else if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (!strcmp(argv[i], "--rom") && i + 1 < argc) {
+            rom_paths.push_back(argv[++i]);
+        } else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (!strcmp(argv[i], "--romdb") && i + 1 < argc) {
+            romdb = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: ./chip8_bench [--filter SUBSTRING] [--rom PATH]... [--romdb PATH] [--out results.json]\n");
+            fprintf(stderr, "       ./chip8_bench --compare base.json new.json\n");
+            return 1;
+        }
+    }
+
+    run_micro();
+    RomImage rom;
+    rom.assign(rom_maze, sizeof(rom_maze));
+    bench_rom("rom_maze", rom);
+    rom.assign(rom_counter, sizeof(rom_counter));
+    bench_rom("rom_counter", rom);
+    rom.assign(rom_alu, sizeof(rom_alu));
+    bench_rom("rom_alu", rom);
+
+    // ROM files run the way the emulator would run them, database profile included
+    RomDb db;
+    const char* db_path = romdb_path(romdb);
+    if (db_path != NULL && !db.load(db_path))
+        return 1;
+    for (const auto& path : rom_paths) {
+        if (!rom.open(path.c_str())) {
+            fprintf(stderr, "Skipping %s\n", path.c_str());
+            continue;
+        }
+        std::string name = path.substr(path.find_last_of('/') + 1);
+        bench_rom("rom_" + name, rom, db_path != NULL ? &db : NULL);
+    }
+    return write_results(out_path);
+}
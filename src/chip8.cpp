@@ -1,5 +1,7 @@
 #include "chip8.hpp"
+#include "rng.hpp"
 
+#include <algorithm>
 #include <iostream>
 
 unsigned char chip8_fontset[80] =
@@ -22,99 +24,452 @@ unsigned char chip8_fontset[80] =
   0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
+// SUPER-CHIP 8x10 digits (FX30); SCHIP 1.1 only has 0-9, A-F follow Octo
+unsigned char schip_fontset[160] =
+{
+  0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+  0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+  0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+  0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+  0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+  0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+  0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+  0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+  0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+  0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+  0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+  0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
+void load_fonts(uint8_t* memory) {
+    memcpy(memory, chip8_fontset, sizeof(chip8_fontset));
+    memcpy(memory + SCHIP_FONT_ADDR, schip_fontset, sizeof(schip_fontset));
+}
+
+Framebuffer::Framebuffer(const Framebuffer& other) {
+    *this = other;
+}
+
+Framebuffer& Framebuffer::operator=(const Framebuffer& other) {
+    if (this == &other)
+        return *this;
+    if (size() != other.size())
+        m_hires.reset(other.m_hires ? new uint8_t[128*64] : nullptr);
+    memcpy(data(), other.data(), size());
+    return *this;
+}
+
+void Framebuffer::resize(size_t size) {
+    if (size == this->size())
+        return;
+    if (size > 64*32) {
+        m_hires.reset(new uint8_t[128*64]);
+        memcpy(m_hires.get(), m_lores, 64*32);
+        memset(m_hires.get() + 64*32, 0, 128*64 - 64*32);
+    } else {
+        memcpy(m_lores, m_hires.get(), 64*32);
+        m_hires.reset();
+    }
+}
+
 Chip8::Chip8() {
     debug = false;
+    memset(rpl, 0, sizeof(rpl));
+    seed(0);
 }
 
 Chip8::Chip8(bool is_debug) {
     debug = is_debug;
+    memset(rpl, 0, sizeof(rpl));
+    seed(0);
+    if (debug) {
+        trace = std::make_shared<TraceBuffer>();
+    }
 }
 
 void Chip8::init() {
+    reset_state();
+    memset(memory, 0, memory.size());
+    load_fonts(memory);
+}
+
+void Chip8::reset(const RomImage& rom) {
+    reset_state();
+    size_t size = std::min(rom.image_size(), memory.size());
+    memcpy(memory, rom.image(), size);
+    memset(memory + size, 0, memory.size() - size);
+}
+
+void Chip8::reset(const ArenaRom& rom) {
+    reset_state();
+    memory.attach(rom);
+}
+
+void Chip8::set_profile(const RomProfile& profile) {
+    quirks = profile.quirks;
+    if (profile.variant > variant)
+        set_variant(profile.variant);
+    if (profile.cycles_per_frame > 0)
+        cycles_per_frame = profile.cycles_per_frame;
+}
+
+void Chip8::set_variant(Variant new_variant) {
+    variant = new_variant;
+    memory.resize(variant == Variant::XoChip ? XO_MEMORY_SIZE : VM_MEMORY_SIZE);
+    gfx.resize(variant >= Variant::SuperChip ? 128*64 : 64*32);
+}
+
+void Chip8::reset_state() {
     pc = 0x200;
     opcode = 0;
     I = 0;
     sp = 0;
+    drawFlag = false;
+    trapped = false;
+    fault = Status::Ok;
+    fault_pc = 0;
+    fault_opcode = 0;
+    faults = 0;
 
     // Zero out attributes
-    memset(gfx, 0, 2048);
-    memset(memory, 0, 4096);
-    memset(stack, 0, 16);
+    hires = false;
+    planes = 1;
+    memset(gfx, 0, gfx.size());
+    memset(stack, 0, sizeof(stack));
     memset(key, 0, 16);
     memset(V, 0, 16);
 
-    // Copy font set into memory
-    for (int i = 0; i < 80; i++) {
-        memory[i] = chip8_fontset[i];
-    }
-
     // Reset timers
     delay_timer = 0;
     sound_timer = 0;
+    memset(audio_pattern, 0, sizeof(audio_pattern));
+    pitch = 64;
 }
 
 bool Chip8::load_file(const char* path) {
-    FILE* fp = fopen(path, "rb");
-    if (fp == NULL) {
-        fprintf(stderr, "Failed to open rom\n");
+    RomImage rom;
+    return rom.open(path) && load_rom(rom);
+}
+
+bool Chip8::load_rom(const RomImage& rom) {
+    set_variant(rom.variant());
+    return load(rom.data(), rom.size());
+}
+
+bool Chip8::load(const unsigned char* data, long data_size) {
+    long limit = memory.size() - 0x200;
+    if (data_size < 0 || data_size > limit) {
+        fprintf(stderr, "ROM is %ld bytes, the limit is %ld\n", data_size, limit);
         return false;
     }
-    fseek(fp, 0, SEEK_END);
-    long rom_size = ftell(fp);
-    rewind(fp);
+    memcpy(memory + 0x200, data, data_size);  // rom data starts at 512
+    return true;
+}
 
-    // Copy ROM data in buffer
-    unsigned char* rom_buffer = (unsigned char*) malloc(sizeof(char) * rom_size);
-    fread(rom_buffer, sizeof(char), (size_t) rom_size, fp);
 
-    load(rom_buffer, rom_size);
+void Chip8::seed(uint64_t seed) {
+    rng_seed(rng, seed);
+}
 
-    fclose(fp);
-    free(rom_buffer);
-    return true;
+uint8_t Chip8::random_byte() {
+    // Top bits of xoshiro128++ are the strongest
+    return rng_next(rng) >> 24;
 }
 
-void Chip8::load(const unsigned char* data, long data_size) {
-    // Copy buffer into memory
-    for (int i = 0; i < data_size; i++) {
-        memory[i + 512] = data[i];  // rom data starts at 512
+const char* status_name(Status status) {
+    switch (status) {
+    case Status::Ok: return "ok";
+    case Status::WaitingForKey: return "waiting_for_key";
+    case Status::IllegalOpcode: return "illegal_opcode";
+    case Status::StackOverflow: return "stack_overflow";
+    case Status::StackUnderflow: return "stack_underflow";
+    case Status::MemoryOutOfRange: return "memory_out_of_range";
+    case Status::AddressWrap: return "address_wrap";
     }
+    return "unknown";
 }
 
+Status Chip8::trap(Status status) {
+    trapped = true;
+    fault = status;
+    fault_pc = pc;
+    fault_opcode = opcode;
+    return status;
+}
 
 void Chip8::set_key(int i, bool value) {
     key[i] = value;
 }
 
-void Chip8::emulate_cycle() {
-    // Op code is two bytes
+int Chip8::emulate_frame() {
+    int executed = 0;
+    for (int i = 0; i < cycles_per_frame; i++) {
+        Status status = emulate_cycle();
+        if (status > Status::WaitingForKey)
+            break;
+        // FX0A waiting on a key does not complete
+        executed += status == Status::Ok;
+    }
+    check_faults();
+    return executed;
+}
+
+Status Chip8::check_faults() {
+    if (trapped)
+        return fault;
+    if (faults & fatal_faults) {
+        opcode = 0;
+        return trap(Status::AddressWrap);
+    }
+    return Status::Ok;
+}
+
+void Chip8::copy_lores(uint8_t* out) const {
+    if (!hires && variant != Variant::XoChip) {
+        memcpy(out, gfx, 64*32);
+        return;
+    }
+    if (!hires) {
+        // Any plane lit counts as white
+        for (int i = 0; i < 64*32; i++) {
+            out[i] = gfx[i] != 0;
+        }
+        return;
+    }
+    // A lo-res pixel is lit if any of its four hi-res pixels is
+    for (int y = 0; y < 32; y++) {
+        const uint8_t* top = &gfx[y * 2 * 128];
+        const uint8_t* bottom = top + 128;
+        for (int x = 0; x < 64; x++) {
+            out[y * 64 + x] = (top[x * 2] | top[x * 2 + 1] | bottom[x * 2] | bottom[x * 2 + 1]) != 0;
+        }
+    }
+}
+
+void Chip8::pack_gfx(uint8_t* out) const {
+    uint8_t screen[64*32];
+    copy_lores(screen);
+    // 8 pixels per byte, leftmost pixel in the high bit
+    for (int i = 0; i < 64*32 / 8; i++) {
+        const uint8_t* p = &screen[i * 8];
+        out[i] = p[0] << 7 | p[1] << 6 | p[2] << 5 | p[3] << 4 | p[4] << 3 | p[5] << 2 | p[6] << 1 | p[7];
+    }
+}
+
+void Chip8::to_argb(uint32_t* pixels) const {
+    int size = width() * height();
+    if (variant != Variant::XoChip) {
+        for (int i = 0; i < size; i++) {
+            pixels[i] = (0x00FFFFFF * gfx[i]) | 0xFF000000;
+        }
+        return;
+    }
+    // Black and white, then Octo's default XO-CHIP colours for plane 2 and both planes
+    static const uint32_t palette[4] = {0xFF000000, 0xFFFFFFFF, 0xFFFF6600, 0xFF662200};
+    for (int i = 0; i < size; i++) {
+        pixels[i] = palette[gfx[i] & 3];
+    }
+}
+
+uint64_t Chip8::gfx_hash() const {
+    // 64-bit FNV-1a over the framebuffer
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < width() * height(); i++) {
+        hash ^= gfx[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+void Chip8::scroll(int dx, int dy) {
+    int w = width();
+    int size = w * height();
+    // Only XO-CHIP can leave a plane out; its pixels are put back afterwards
+    uint8_t kept[128*64];
+    bool partial = variant == Variant::XoChip && planes != 3;
+    if (partial)
+        memcpy(kept, gfx, size);
+
+    if (dy > 0) {
+        memmove(gfx + dy * w, gfx, size - dy * w);
+        memset(gfx, 0, dy * w);
+    } else if (dy < 0) {
+        memmove(gfx, gfx - dy * w, size + dy * w);
+        memset(gfx + size + dy * w, 0, -dy * w);
+    }
+    for (uint8_t* row = gfx; dx != 0 && row < gfx + size; row += w) {
+        if (dx > 0) {
+            memmove(row + dx, row, w - dx);
+            memset(row, 0, dx);
+        } else {
+            memmove(row, row - dx, w + dx);
+            memset(row + w + dx, 0, -dx);
+        }
+    }
+
+    if (partial) {
+        for (int i = 0; i < size; i++) {
+            gfx[i] = (kept[i] & ~planes) | (gfx[i] & planes);
+        }
+    }
+}
+
+uint16_t Chip8::skip_length() const {
+    // XO-CHIP skips all of F000 NNNN
+    if (variant != Variant::XoChip)
+        return 2;
+    uint16_t mask = memory.size() - 1;
+    return memory[(pc + 2) & mask] == 0xF0 && memory[(pc + 3) & mask] == 0x00 ? 4 : 2;
+}
+
+bool Chip8::draw_sprite(uint16_t addr, uint8_t x, uint8_t y, int height, int sprite_width, uint8_t plane) {
+    const uint16_t mask = memory.size() - 1;
+    int row_shift = hires ? 7 : 6;
+    int screen_mask = hires ? 128*64 - 1 : 64*32 - 1;
+    bool collision = false;
+    uint16_t pixel;
+    uint16_t idx;
+    for (int dy = 0; dy < height; dy++) {
+        if (sprite_width == 16)
+            pixel = memory[(addr + dy * 2) & mask] << 8 | memory[(addr + dy * 2 + 1) & mask];
+        else
+            pixel = memory[(addr + dy) & mask] << 8;
+        for (int dx = 0; dx < sprite_width; dx++) {
+            if ((pixel & (0x8000 >> dx)) != 0) {
+                // Sprite has a 1 in this position; off-screen pixels wrap
+                idx = (x + dx + ((y + dy) << row_shift)) & screen_mask;
+                if (gfx[idx] & plane)
+                    collision = true;
+                gfx[idx] ^= plane;
+            }
+        }
+    }
+    return collision;
+}
+
+DataAccess Chip8::data_access() const {
+    // Sizes follow emulate_cycle; opcodes this variant traps on touch nothing
+    const uint16_t mask = memory.size() - 1;
+    uint16_t op_word = memory[pc & mask] << 8 | memory[(pc + 1) & mask];
+    int x = (op_word & 0x0F00) >> 8;
+    int y = (op_word & 0x00F0) >> 4;
+    Op op = decode(op_word);
+    if (op_variant(op) > variant)
+        return DataAccess{I, 0, false};
+    switch (op) {
+    case Op::LD_B:      return DataAccess{I, 3, true};
+    case Op::LD_MEM:    return DataAccess{I, x + 1, true};
+    case Op::LD_X_MEM:  return DataAccess{I, x + 1, false};
+    case Op::SAVE_XY:   return DataAccess{I, (x < y ? y - x : x - y) + 1, true};
+    case Op::LOAD_XY:   return DataAccess{I, (x < y ? y - x : x - y) + 1, false};
+    case Op::AUDIO:     return DataAccess{I, 16, false};
+    case Op::LD_I_LONG: return DataAccess{(uint16_t) (pc + 2), 2, false};
+    case Op::DRW: {
+        int bytes = op_word & 0x000F;
+        if (bytes == 0 && variant >= Variant::SuperChip)
+            bytes = 32;
+        // XO-CHIP reads one sprite per selected plane, back to back
+        if (variant == Variant::XoChip)
+            bytes *= (planes & 1) + (planes >> 1 & 1);
+        return DataAccess{I, bytes, false};
+    }
+    default:
+        return DataAccess{I, 0, false};
+    }
+}
+
+Status Chip8::emulate_cycle() {
+    if (trapped)
+        return fault;
+
+    // Op code is two bytes; 4KB addresses wrap at 0xFFF, XO-CHIP's 64KB at 0xFFFF
+    const uint16_t mask = memory.size() - 1;
+    if (pc > mask - 1) {
+        opcode = 0;
+        return trap(Status::MemoryOutOfRange);
+    }
     opcode = memory[pc] << 8 | memory[pc+1];
     uint8_t x;
     uint8_t y;
 
     if (debug) {
-        fprintf(stderr, "Op code: 0x%X\n", opcode);
+        trace->record(*this);
     }
 
+#ifdef CHIP8_PROFILE
+    profiler.on_cycle(pc, opcode);
+#endif
+
     // Switch on first 4 bits
     switch(opcode & 0xF000) {
     case(0x0000):
         switch (opcode & 0x00FF) {
         case(0x00E0):
-            // 00E0: Clear the screen
-            memset(gfx, 0, 2048);
+            // 00E0: Clear the screen (XO-CHIP: the selected planes)
+            if (variant == Variant::XoChip && planes != 3) {
+                for (int i = 0; i < width() * height(); i++) {
+                    gfx[i] &= ~planes;
+                }
+            } else {
+                memset(gfx, 0, width() * height());
+            }
             pc += 2;
             drawFlag = true;
             break;
         case(0x00EE):
             // 00EE: Return from a subroutine
+            if (sp == 0)
+                return trap(Status::StackUnderflow);
             sp--;
             pc = stack[sp];
             pc += 2;
             break;
+        case(0x00FB):
+            // 00FB: SUPER-CHIP, scroll right by 4 pixels
+            if (variant < Variant::SuperChip)
+                return trap(Status::IllegalOpcode);
+            scroll(4, 0);
+            pc += 2;
+            drawFlag = true;
+            break;
+        case(0x00FC):
+            // 00FC: SUPER-CHIP, scroll left by 4 pixels
+            if (variant < Variant::SuperChip)
+                return trap(Status::IllegalOpcode);
+            scroll(-4, 0);
+            pc += 2;
+            drawFlag = true;
+            break;
+        case(0x00FE):
+        case(0x00FF):
+            // 00FE/00FF: SUPER-CHIP, switch to lo-res/hi-res and clear the screen
+            if (variant < Variant::SuperChip)
+                return trap(Status::IllegalOpcode);
+            hires = (opcode & 0x0001) != 0;
+            memset(gfx, 0, gfx.size());
+            pc += 2;
+            drawFlag = true;
+            break;
         default:
-            fprintf(stderr, "Unknown opcode [0x000*]: 0x%X\n", opcode);
-            exit(1);
+            if ((opcode & 0x00F0) == 0x00C0 && variant >= Variant::SuperChip) {
+                // 00CN: SUPER-CHIP, scroll down by N pixels
+                scroll(0, opcode & 0x000F);
+                pc += 2;
+                drawFlag = true;
+                break;
+            }
+            if ((opcode & 0x00F0) == 0x00D0 && variant >= Variant::XoChip) {
+                // 00DN: XO-CHIP, scroll up by N pixels
+                scroll(0, -(opcode & 0x000F));
+                pc += 2;
+                drawFlag = true;
+                break;
+            }
+            return trap(Status::IllegalOpcode);
         }
         break;
     case(0x1000):
@@ -125,6 +480,8 @@ void Chip8::emulate_cycle() {
         // 2NNN: Call subroutine at NNN
         // Store current pc address on stack, then jump pc to NNN
         // Note: do not increment pc!
+        if (sp == 16)
+            return trap(Status::StackOverflow);
         stack[sp++] = pc;
         pc = opcode & 0x0FFF;
         break;
@@ -132,23 +489,49 @@ void Chip8::emulate_cycle() {
         // 3XNN: Skips next instr if V[x] == NN
         x = (opcode & 0x0F00) >> 8;
         if (V[x] == (opcode & 0x00FF))
-            pc += 2;
+            pc += skip_length();
         pc += 2;
         break;
     case(0x4000):
         // 4XNN: Skips next instr if V[x] != NN
         x = (opcode & 0x0F00) >> 8;
         if (V[x] != (opcode & 0x00FF))
-            pc += 2;
+            pc += skip_length();
         pc += 2;
         break;
     case(0x5000):
-        // 5XY0: Skips next instr if V[x] == V[y]
         x = (opcode & 0x0F00) >> 8;
         y = (opcode & 0x00F0) >> 4;
-        if (V[x] == V[y])
+        switch (opcode & 0x000F) {
+        case(0x0000):
+            // 5XY0: Skips next instr if V[x] == V[y]
+            if (V[x] == V[y])
+                pc += skip_length();
             pc += 2;
-        pc += 2;
+            break;
+        case(0x0002):
+            // 5XY2: XO-CHIP, store VX to VY (in either order) at I. I is not modified.
+            if (variant < Variant::XoChip)
+                return trap(Status::IllegalOpcode);
+            for (int i = 0; i <= (x < y ? y - x : x - y); i++) {
+                memory[(I + i) & mask] = V[x < y ? x + i : x - i];
+            }
+            faults |= (I + (x < y ? y - x : x - y) > mask) * FAULT_WRITE_WRAP;
+            pc += 2;
+            break;
+        case(0x0003):
+            // 5XY3: XO-CHIP, load VX to VY (in either order) from I. I is not modified.
+            if (variant < Variant::XoChip)
+                return trap(Status::IllegalOpcode);
+            for (int i = 0; i <= (x < y ? y - x : x - y); i++) {
+                V[x < y ? x + i : x - i] = memory[(I + i) & mask];
+            }
+            faults |= (I + (x < y ? y - x : x - y) > mask) * FAULT_READ_WRAP;
+            pc += 2;
+            break;
+        default:
+            return trap(Status::IllegalOpcode);
+        }
         break;
     case(0x6000):
         // 6XNN: Sets V[x] to NN
@@ -213,9 +596,11 @@ void Chip8::emulate_cycle() {
             break;
         case (0x0006):
             // 8XY6: Store least sig bit of VX in VF and shifts VX to the right by 1
+            // (shift_vy quirk: VX = VY >> 1)
             x = (opcode & 0x0F00) >> 8;
-            V[0xF] = (V[x] & 0x0001);
-            V[x] >>= 1;
+            y = quirks.shift_vy ? (opcode & 0x00F0) >> 4 : x;
+            V[0xF] = (V[y] & 0x0001);
+            V[x] = V[y] >> 1;
             pc += 2;
             break;
         case (0x0007):
@@ -228,14 +613,15 @@ void Chip8::emulate_cycle() {
             break;
         case (0x000E):
             // 8XYE: Store most sig bit of VX in VF and shifts VX to the left by 1
+            // (shift_vy quirk: VX = VY << 1)
             x = (opcode & 0x0F00) >> 8;
-            V[0xF] = (V[x] >> 7);
-            V[x] <<= 1;
+            y = quirks.shift_vy ? (opcode & 0x00F0) >> 4 : x;
+            V[0xF] = (V[y] >> 7);
+            V[x] = V[y] << 1;
             pc += 2;
             break;
         default:
-            fprintf(stderr, "Unknown opcode [0x800*]: 0x%X\n", opcode);
-            exit(1);
+            return trap(Status::IllegalOpcode);
         }
         break;
     case(0x9000):
@@ -243,7 +629,7 @@ void Chip8::emulate_cycle() {
         x = (opcode & 0x0F00) >> 8;
         y = (opcode & 0x00F0) >> 4;
         if (V[x] != V[y])
-            pc += 2;
+            pc += skip_length();
         pc += 2;
         break;
     case(0xA000):
@@ -257,33 +643,40 @@ void Chip8::emulate_cycle() {
         pc = (opcode & 0x0FFF) + V[0];
         break;
     case(0xC000):
-        // CXNN: VX = rand() & NN, 0 <= rand() <= 255
-        // for random number generation see:
-        //   https://stackoverflow.com/a/12657984
+        // CXNN: VX = random byte & NN
         x = (opcode & 0x0F00) >> 8;
-        V[x] = (opcode & 0x00FF) & (rand() % (0xFF + 1));
+        V[x] = (opcode & 0x00FF) & random_byte();
         pc += 2;
         break;
     case(0xD000): {
         // DXYN: Draw sprite
+        // (SUPER-CHIP: DXY0 draws a 16x16 sprite, two bytes per row;
+        // XO-CHIP: one sprite per selected plane, stored back to back)
         x = V[(opcode & 0x0F00) >> 8];
         y = V[(opcode & 0x00F0) >> 4];
         uint8_t height = opcode & 0x000F;
-        uint8_t pixel;
-        uint16_t idx;
-        
-        V[0xF] = 0;
-        for (int dy = 0; dy < height; dy++) {
-            pixel = memory[I + dy];
-            for (int dx = 0; dx < 8; dx++) {
-                if ((pixel & (0x80 >> dx)) != 0) {
-                    // Sprite has a 1 in this position
-                    idx = x + dx + ((y + dy) * 64);
-                    if (gfx[idx] == 1)
-                        V[0xF] = 1;
-                    gfx[idx] ^= 1;
-                }
+        int sprite_width = 8;
+        if (height == 0 && variant >= Variant::SuperChip) {
+            height = 16;
+            sprite_width = 16;
+        }
+        int bytes = height * sprite_width / 8;
+
+        // Classic ROMs draw plane 1 only, through a call the compiler can specialize
+        if (variant != Variant::XoChip) {
+            V[0xF] = draw_sprite(I, x, y, height, sprite_width, 1);
+            faults |= (I + bytes - 1 > mask) * FAULT_READ_WRAP;
+        } else {
+            bool collision = false;
+            uint16_t addr = I;
+            for (uint8_t plane = 1; plane <= 2; plane <<= 1) {
+                if ((planes & plane) == 0)
+                    continue;
+                collision |= draw_sprite(addr, x, y, height, sprite_width, plane);
+                faults |= (addr + bytes - 1 > mask) * FAULT_READ_WRAP;
+                addr += bytes;
             }
+            V[0xF] = collision;
         }
         drawFlag = true;
         pc += 2;
@@ -294,24 +687,49 @@ void Chip8::emulate_cycle() {
         case(0x009E):
             // EX9E: Skips the next instruction if key[V[X]] is pressed
             x = (opcode & 0x0F00) >> 8;
-            if (key[V[x]] != 0)
-                pc += 2;
+            if (key[V[x] & 0xF] != 0)
+                pc += skip_length();
             pc +=2;
             break;
         case(0x00A1):
             // EXA1: Skips the next instruction if key[V[X]] is not pressed
             x = (opcode & 0x0F00) >> 8;
-            if (key[V[x]] == 0)
-                pc += 2;
+            if (key[V[x] & 0xF] == 0)
+                pc += skip_length();
             pc +=2;
             break;
         default:
-            fprintf(stderr, "Unknown opcode [0xE0**]: 0x%X\n", opcode);
-            exit(1);
+            return trap(Status::IllegalOpcode);
         }
         break;
     case(0xF000):
         switch (opcode & 0x0FF) {
+        case(0x0000):
+            // F000 NNNN: XO-CHIP, I = the 16-bit address in the next word
+            if (opcode != 0xF000 || variant < Variant::XoChip)
+                return trap(Status::IllegalOpcode);
+            I = memory[(pc + 2) & mask] << 8 | memory[(pc + 3) & mask];
+            faults |= (pc + 3 > mask) * FAULT_READ_WRAP;
+            pc += 4;
+            break;
+        case(0x0001):
+            // FN01: XO-CHIP, select the planes DXYN, 00E0 and the scrolls work on
+            x = (opcode & 0x0F00) >> 8;
+            if (x > 3 || variant < Variant::XoChip)
+                return trap(Status::IllegalOpcode);
+            planes = x;
+            pc += 2;
+            break;
+        case(0x0002):
+            // F002: XO-CHIP, load the 16-byte audio pattern from I
+            if (opcode != 0xF002 || variant < Variant::XoChip)
+                return trap(Status::IllegalOpcode);
+            for (int i = 0; i < 16; i++) {
+                audio_pattern[i] = memory[(I + i) & mask];
+            }
+            faults |= (I + 15 > mask) * FAULT_READ_WRAP;
+            pc += 2;
+            break;
         case(0x0007):
             // FX07: sets VX to delay timer
             x = (opcode & 0x0F00) >> 8;
@@ -329,7 +747,7 @@ void Chip8::emulate_cycle() {
                 }
             }
             if (!key_pressed)
-                return;
+                return Status::WaitingForKey;
             pc += 2;
         }
             break;
@@ -359,39 +777,76 @@ void Chip8::emulate_cycle() {
             I = V[x] * 5;
             pc += 2;
             break;
+        case(0x0030):
+            // FX30: SUPER-CHIP, point I at the 8x10 digit for the low nibble of VX
+            if (variant < Variant::SuperChip)
+                return trap(Status::IllegalOpcode);
+            x = (opcode & 0x0F00) >> 8;
+            I = SCHIP_FONT_ADDR + (V[x] & 0xF) * 10;
+            pc += 2;
+            break;
         case(0x0033):
             // FX33: store binary-coded decimal representation of V[X] at the addresses I, I+1, and I+2
             // e.g. for V[X] == 150: V[i] = 1; V[i+1] = 5; v[i+2] = 0
             x = (opcode & 0x0F00) >> 8;
-            memory[I] = V[x] / 100;
-            memory[I+1] = (V[x] % 100) / 10;
-            memory[I+2] = V[x] % 10;
+            memory[I & mask] = V[x] / 100;
+            memory[(I+1) & mask] = (V[x] % 100) / 10;
+            memory[(I+2) & mask] = V[x] % 10;
+            faults |= (I + 2 > mask) * FAULT_WRITE_WRAP;
+            pc += 2;
+            break;
+        case(0x003A):
+            // FX3A: XO-CHIP, set the audio pitch register to VX
+            if (variant < Variant::XoChip)
+                return trap(Status::IllegalOpcode);
+            x = (opcode & 0x0F00) >> 8;
+            pitch = V[x];
             pc += 2;
             break;
         case(0x0055):
             // FX55: stores from V0 to VX into memory, starting at address I. I is not modified.
             x = (opcode & 0x0F00) >> 8;
             for (int i = 0; i <= x; i++) {
-                memory[I+i] = V[i];
+                memory[(I+i) & mask] = V[i];
             }
+            faults |= (I + x > mask) * FAULT_WRITE_WRAP;
+            if (quirks.load_store_inc)
+                I += x + 1;
             pc += 2;
             break;
         case(0x0065):
             // FX65: Fills from V0 to VX from memory, starting at address I. I is not modified.
             x = (opcode & 0x0F00) >> 8;
             for (int i = 0; i <= x; i++) {
-                V[i] = memory[I+i];
+                V[i] = memory[(I+i) & mask];
             }
+            faults |= (I + x > mask) * FAULT_READ_WRAP;
+            if (quirks.load_store_inc)
+                I += x + 1;
+            pc += 2;
+            break;
+        case(0x0075):
+            // FX75: SUPER-CHIP, save V0 to VX in the RPL flags
+            if (variant < Variant::SuperChip)
+                return trap(Status::IllegalOpcode);
+            x = (opcode & 0x0F00) >> 8;
+            memcpy(rpl, V, x + 1);
+            pc += 2;
+            break;
+        case(0x0085):
+            // FX85: SUPER-CHIP, restore V0 to VX from the RPL flags
+            if (variant < Variant::SuperChip)
+                return trap(Status::IllegalOpcode);
+            x = (opcode & 0x0F00) >> 8;
+            memcpy(V, rpl, x + 1);
             pc += 2;
             break;
         default:
-            fprintf(stderr, "Unknown opcode [0xF0**]: 0x%X\n", opcode);
-            exit(1);
+            return trap(Status::IllegalOpcode);
         }
         break;
     default:
-        fprintf(stderr, "Unknown opcode [0x*000]: 0x%X\n", opcode);
-        exit(1);
+        return trap(Status::IllegalOpcode);
     }
 
     if (delay_timer > 0)
@@ -403,4 +858,5 @@ void Chip8::emulate_cycle() {
             // TODO: BEEP!
         }
     }
+    return Status::Ok;
 }
@@ -1,30 +1,157 @@
 #pragma once
 
+#include <memory>
+
 #include <SDL2/SDL.h>
 
+#include "arena.hpp"
+#include "rom.hpp"
+#include "trace.hpp"
+
+#ifdef CHIP8_PROFILE
+#include "profiler.hpp"
+#endif
+
 /*
   See: https://multigesture.net/articles/how-to-write-an-emulator-chip-8-interpreter/
 
   Memory Map:
   0x000-0x1FF - Chip 8 interpreter (contains font set in emu)
-  0x050-0x0A0 - Used for the built in 4x5 pixel font set (0-F)
+  0x000-0x050 - Built in 4x5 pixel font set (0-F)
+  0x050-0x0F0 - SUPER-CHIP 8x10 pixel font set (0-F)
   0x200-0xFFF - Program ROM and work RAM
+  0x1000-0xFFFF - XO-CHIP only: more ROM and RAM, reached through F000 NNNN
 */
 
+// The main loop throttles to one cycle every 1200us, so a 60Hz frame is ~14 cycles
+#define CYCLES_PER_FRAME 14
+
+// ROMs load at 0x200 and may fill the rest of memory
+#define MAX_ROM_SIZE (4096 - 512)
+#define MAX_XO_ROM_SIZE (65536 - 512)
+
+extern unsigned char chip8_fontset[80];
+extern unsigned char schip_fontset[160];
+
+#define SCHIP_FONT_ADDR 0x50
+
+// Writes both font sets into the interpreter area below 0x200
+void load_fonts(uint8_t* memory);
+
+// Result of one emulate_cycle. Every status after WaitingForKey is a fault:
+// the VM sets trapped, records fault_pc and fault_opcode, and stops executing
+// until init(). What to do about it is up to the caller.
+enum class Status : uint8_t {
+    Ok,
+    WaitingForKey,     // FX0A with no key down; pc stays on the instruction
+    IllegalOpcode,
+    StackOverflow,
+    StackUnderflow,
+    MemoryOutOfRange,  // pc ran off the end of memory
+    AddressWrap,       // a fatal sticky fault was found at the end of a frame, see check_faults()
+};
+
+// Sticky fault bits. Every data address is masked to the size of memory, so
+// an access past the end wraps around instead of leaving the VM. Instructions
+// that can wrap OR the matching bit into faults without branching; frame loops
+// look at them once per frame through check_faults(). The call stack and pc
+// still trap on the instruction itself: a wrapped return address or fetch
+// would send the ROM somewhere arbitrary, and those checks sit on CALL/RET
+// and one well-predicted compare per fetch.
+#define FAULT_READ_WRAP  0x1  // FX65, 5XY3, F002, F000 NNNN or a sprite read wrapped
+#define FAULT_WRITE_WRAP 0x2  // FX33, FX55 or 5XY2 wrote across the end of memory
+
+const char* status_name(Status status);
+
+// Data memory an instruction reads or writes besides its own opcode word
+struct DataAccess {
+    uint16_t addr;  // first byte; the access wraps at the end of memory
+    int count;      // 0 when the instruction touches no data memory
+    bool writes;
+};
+
+// One byte per pixel. CHIP-8 screens live inline in 64*32 bytes; the
+// 128*64 hi-res buffer is allocated only for variants that can switch to
+// it, so copying or resetting a classic VM touches 2KB rather than 8KB.
+class Framebuffer {
+public:
+    Framebuffer() {}
+    Framebuffer(const Framebuffer& other);
+    Framebuffer(Framebuffer&&) = default;
+    Framebuffer& operator=(const Framebuffer& other);
+    Framebuffer& operator=(Framebuffer&&) = default;
+
+    void resize(size_t size);  // 64*32 or 128*64; keeps the first min(old, new) bytes, zeroes the rest
+    size_t size() const { return m_hires ? 128*64 : 64*32; }
+
+    operator uint8_t*() { return data(); }
+    operator const uint8_t*() const { return data(); }
+
+private:
+    uint8_t* data() { return m_hires ? m_hires.get() : m_lores; }
+    const uint8_t* data() const { return m_hires ? m_hires.get() : m_lores; }
+
+    std::unique_ptr<uint8_t[]> m_hires;
+    uint8_t m_lores[64*32] = {};
+};
+
 class Chip8 {
 public:
     Chip8();
     Chip8(bool);
     void init();
+    void reset(const RomImage& rom);  // init() plus load in one memcpy
+    void reset(const ArenaRom& rom);  // init() plus load, sharing the image's pages where the platform can
+    void set_profile(const RomProfile& profile);
+    void set_variant(Variant variant);  // XO-CHIP grows memory to 64KB; SUPER-CHIP and XO-CHIP get a hi-res gfx
     bool load_file(const char*);
-    void load(const unsigned char* data, long data_size);
-    void emulate_cycle();
+    bool load_rom(const RomImage& rom);  // the variant the ROM needs, then load()
+    bool load(const unsigned char* data, long data_size);  // false if it does not fit memory
+    Status emulate_cycle();
+    int emulate_frame();  // returns instructions completed (not FX0A waits); ends with check_faults()
+    // Traps with AddressWrap if faults has a bit from fatal_faults; fault_pc
+    // is then where the frame stopped, not the instruction that wrapped
+    Status check_faults();
+    DataAccess data_access() const;  // of the instruction at pc, before it runs
     void set_key(int, bool);
+    int width() const { return hires ? 128 : 64; }
+    int height() const { return hires ? 64 : 32; }
+    void copy_lores(uint8_t* out) const;  // 64x32 bytes; hi-res is downsampled 2x2
+    void pack_gfx(uint8_t* out) const;  // 256 bytes, from copy_lores()
+    void to_argb(uint32_t* pixels) const;  // width() * height() pixels
+    uint64_t gfx_hash() const;
+    void seed(uint64_t seed);  // restarts the CXNN stream; init() leaves it alone
+    uint8_t random_byte();
+
+private:
+    Status trap(Status status);
+    void reset_state();
+    void scroll(int dx, int dy);  // selected planes only; pixels shifted in are off
+    uint16_t skip_length() const;
+    // XORs one plane of a sprite at addr into gfx; true if a lit pixel was erased
+    bool draw_sprite(uint16_t addr, uint8_t x, uint8_t y, int height, int sprite_width, uint8_t plane);
 
+public:
+    uint32_t rng[4];       // xoshiro128++ state for CXNN, copied with the VM
+    Quirks quirks;         // per-ROM behaviour, kept across init() and reset()
+    Variant variant = Variant::Chip8;  // instruction set, kept like quirks; see set_variant()
+    int cycles_per_frame = CYCLES_PER_FRAME;
     uint16_t pc;           // program counter
-    bool debug;
+    bool debug;            // records every instruction into trace
+    std::shared_ptr<TraceBuffer> trace;
     bool drawFlag;
-    uint8_t gfx[64*32];    // array of pixels, 1=white, 0=black
+    bool trapped;          // set on any fault; pc is left on the faulting instruction
+    Status fault;          // the fault that trapped the VM, Ok otherwise
+    uint16_t fault_pc;
+    uint16_t fault_opcode;
+    uint8_t faults;        // FAULT_* bits seen since init()
+    uint8_t fatal_faults = 0;  // FAULT_* bits check_faults() traps on, kept across init()
+    bool hires;            // SUPER-CHIP 128x64 mode
+    uint8_t planes;        // XO-CHIP FN01 plane mask, 1 everywhere else
+    // Pixels, width() per row: lo-res only uses the first 64*32 bytes, laid
+    // out exactly as on plain CHIP-8. Bit 0 is plane 1 (1=white, 0=black);
+    // XO-CHIP draws plane 2 into bit 1 of the same byte. Sized by set_variant()
+    Framebuffer gfx;
     uint8_t keymap[16] = {
         SDLK_x,
         SDLK_1,
@@ -46,16 +173,24 @@ public:
 
     uint16_t opcode;
 
-    uint8_t memory[4096];  // 4KB system memory
+    VmMemory memory;       // 4KB system memory (64KB for XO-CHIP), see arena.hpp
 
     uint8_t V[16];         // V registers
     uint16_t I;            // I register
 
     uint8_t delay_timer;
     uint8_t sound_timer;
+    uint8_t audio_pattern[16];  // XO-CHIP F002: 128 1-bit samples played while sound_timer runs
+    uint8_t pitch;              // XO-CHIP FX3A: playback at 4000*2^((pitch-64)/48) Hz
+
+    uint8_t rpl[16];       // SUPER-CHIP RPL user flags (FX75/FX85), survive init()
 
     uint16_t stack[16];
     uint16_t sp;           // stack pointer
 
     uint8_t key[16];       // hex based keypad
+
+#ifdef CHIP8_PROFILE
+    Profiler profiler;
+#endif
 };
@@ -0,0 +1,86 @@
+#include <stdio.h>
+
+#include "decode.hpp"
+
+static const char* op_patterns[NUM_OPS] = {
+    "00E0", "00EE", "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "6XNN", "7XNN",
+    "8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7", "8XYE",
+    "9XY0", "ANNN", "BNNN", "CXNN", "DXYN", "EX9E", "EXA1",
+    "FX07", "FX0A", "FX15", "FX18", "FX1E", "FX29", "FX33", "FX55", "FX65",
+    "00CN", "00FB", "00FC", "00FE", "00FF", "FX30", "FX75", "FX85",
+    "00DN", "5XY2", "5XY3", "F000", "FN01", "F002", "FX3A",
+    "illegal",
+};
+
+const char* variant_name(Variant variant) {
+    switch (variant) {
+    case Variant::Chip8: return "CHIP-8";
+    case Variant::SuperChip: return "SUPER-CHIP";
+    case Variant::XoChip: return "XO-CHIP";
+    }
+    return "?";
+}
+
+const char* op_pattern(Op op) {
+    return op_patterns[(int) op];
+}
+
+void format_instruction(uint16_t opcode, char* out, size_t size) {
+    int x = (opcode & 0x0F00) >> 8;
+    int y = (opcode & 0x00F0) >> 4;
+    int n = opcode & 0x000F;
+    int nn = opcode & 0x00FF;
+    int nnn = opcode & 0x0FFF;
+    switch (decode(opcode)) {
+    case Op::CLS:      snprintf(out, size, "CLS"); break;
+    case Op::RET:      snprintf(out, size, "RET"); break;
+    case Op::JP:       snprintf(out, size, "JP 0x%03X", nnn); break;
+    case Op::CALL:     snprintf(out, size, "CALL 0x%03X", nnn); break;
+    case Op::SE_NN:    snprintf(out, size, "SE V%X, 0x%02X", x, nn); break;
+    case Op::SNE_NN:   snprintf(out, size, "SNE V%X, 0x%02X", x, nn); break;
+    case Op::SE_XY:    snprintf(out, size, "SE V%X, V%X", x, y); break;
+    case Op::LD_NN:    snprintf(out, size, "LD V%X, 0x%02X", x, nn); break;
+    case Op::ADD_NN:   snprintf(out, size, "ADD V%X, 0x%02X", x, nn); break;
+    case Op::LD_XY:    snprintf(out, size, "LD V%X, V%X", x, y); break;
+    case Op::OR:       snprintf(out, size, "OR V%X, V%X", x, y); break;
+    case Op::AND:      snprintf(out, size, "AND V%X, V%X", x, y); break;
+    case Op::XOR:      snprintf(out, size, "XOR V%X, V%X", x, y); break;
+    case Op::ADD_XY:   snprintf(out, size, "ADD V%X, V%X", x, y); break;
+    case Op::SUB:      snprintf(out, size, "SUB V%X, V%X", x, y); break;
+    case Op::SHR:      snprintf(out, size, "SHR V%X, V%X", x, y); break;
+    case Op::SUBN:     snprintf(out, size, "SUBN V%X, V%X", x, y); break;
+    case Op::SHL:      snprintf(out, size, "SHL V%X, V%X", x, y); break;
+    case Op::SNE_XY:   snprintf(out, size, "SNE V%X, V%X", x, y); break;
+    case Op::LD_I:     snprintf(out, size, "LD I, 0x%03X", nnn); break;
+    case Op::JP_V0:    snprintf(out, size, "JP V0, 0x%03X", nnn); break;
+    case Op::RND:      snprintf(out, size, "RND V%X, 0x%02X", x, nn); break;
+    case Op::DRW:      snprintf(out, size, "DRW V%X, V%X, %d", x, y, n); break;
+    case Op::SKP:      snprintf(out, size, "SKP V%X", x); break;
+    case Op::SKNP:     snprintf(out, size, "SKNP V%X", x); break;
+    case Op::LD_X_DT:  snprintf(out, size, "LD V%X, DT", x); break;
+    case Op::LD_X_K:   snprintf(out, size, "LD V%X, K", x); break;
+    case Op::LD_DT:    snprintf(out, size, "LD DT, V%X", x); break;
+    case Op::LD_ST:    snprintf(out, size, "LD ST, V%X", x); break;
+    case Op::ADD_I:    snprintf(out, size, "ADD I, V%X", x); break;
+    case Op::LD_F:     snprintf(out, size, "LD F, V%X", x); break;
+    case Op::LD_B:     snprintf(out, size, "LD B, V%X", x); break;
+    case Op::LD_MEM:   snprintf(out, size, "LD [I], V%X", x); break;
+    case Op::LD_X_MEM: snprintf(out, size, "LD V%X, [I]", x); break;
+    case Op::SCD:      snprintf(out, size, "SCD %d", n); break;
+    case Op::SCR:      snprintf(out, size, "SCR"); break;
+    case Op::SCL:      snprintf(out, size, "SCL"); break;
+    case Op::LOW:      snprintf(out, size, "LOW"); break;
+    case Op::HIGH:     snprintf(out, size, "HIGH"); break;
+    case Op::LD_HF:    snprintf(out, size, "LD HF, V%X", x); break;
+    case Op::LD_R:     snprintf(out, size, "LD R, V%X", x); break;
+    case Op::LD_X_R:   snprintf(out, size, "LD V%X, R", x); break;
+    case Op::SCU:      snprintf(out, size, "SCU %d", n); break;
+    case Op::SAVE_XY:  snprintf(out, size, "LD [I], V%X-V%X", x, y); break;
+    case Op::LOAD_XY:  snprintf(out, size, "LD V%X-V%X, [I]", x, y); break;
+    case Op::LD_I_LONG: snprintf(out, size, "LD I, long"); break;
+    case Op::PLANE:    snprintf(out, size, "PLANE %d", x); break;
+    case Op::AUDIO:    snprintf(out, size, "AUDIO"); break;
+    case Op::PITCH:    snprintf(out, size, "PITCH V%X", x); break;
+    case Op::ILLEGAL:  snprintf(out, size, "DW 0x%04X", opcode); break;
+    }
+}
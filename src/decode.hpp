@@ -0,0 +1,173 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  Instruction decoding shared by the profiler and the disassembler.
+
+  decode() classifies an opcode exactly the way the switch in
+  Chip8::emulate_cycle dispatches it: every opcode emulate_cycle traps on as
+  illegal decodes to Op::ILLEGAL and nothing else does (the opcode tests
+  check this over all 65536 opcodes). Opcodes from later instruction sets
+  decode in every variant; op_variant() says which variant a VM needs before
+  emulate_cycle executes them instead of trapping. Mnemonics follow Cowgod's
+  reference, the SUPER-CHIP 1.1 documentation and the XO-CHIP spec; F000
+  NNNN is the one four-byte instruction (op_length()).
+*/
+
+enum class Variant : uint8_t {
+    Chip8,
+    SuperChip,  // 128x64 hi-res, scrolling, 16x16 sprites, big font, RPL flags
+    XoChip,     // SuperChip plus 64KB memory, two bitplanes, audio patterns
+};
+
+const char* variant_name(Variant variant);
+
+enum class Op : uint8_t {
+    CLS,       // 00E0
+    RET,       // 00EE
+    JP,        // 1NNN
+    CALL,      // 2NNN
+    SE_NN,     // 3XNN
+    SNE_NN,    // 4XNN
+    SE_XY,     // 5XY0
+    LD_NN,     // 6XNN
+    ADD_NN,    // 7XNN
+    LD_XY,     // 8XY0
+    OR,        // 8XY1
+    AND,       // 8XY2
+    XOR,       // 8XY3
+    ADD_XY,    // 8XY4
+    SUB,       // 8XY5
+    SHR,       // 8XY6
+    SUBN,      // 8XY7
+    SHL,       // 8XYE
+    SNE_XY,    // 9XY0
+    LD_I,      // ANNN
+    JP_V0,     // BNNN
+    RND,       // CXNN
+    DRW,       // DXYN
+    SKP,       // EX9E
+    SKNP,      // EXA1
+    LD_X_DT,   // FX07
+    LD_X_K,    // FX0A
+    LD_DT,     // FX15
+    LD_ST,     // FX18
+    ADD_I,     // FX1E
+    LD_F,      // FX29
+    LD_B,      // FX33
+    LD_MEM,    // FX55
+    LD_X_MEM,  // FX65
+    SCD,       // 00CN
+    SCR,       // 00FB
+    SCL,       // 00FC
+    LOW,       // 00FE
+    HIGH,      // 00FF
+    LD_HF,     // FX30
+    LD_R,      // FX75
+    LD_X_R,    // FX85
+    SCU,       // 00DN
+    SAVE_XY,   // 5XY2
+    LOAD_XY,   // 5XY3
+    LD_I_LONG, // F000 NNNN
+    PLANE,     // FN01
+    AUDIO,     // F002
+    PITCH,     // FX3A
+    ILLEGAL,
+};
+
+#define NUM_OPS ((int) Op::ILLEGAL + 1)
+
+inline Op decode(uint16_t opcode) {
+    switch (opcode & 0xF000) {
+    case(0x0000):
+        // Like emulate_cycle, only the low byte is checked, so 0NE0/0NEE alias 00E0/00EE
+        if ((opcode & 0x00FF) == 0x00E0) return Op::CLS;
+        if ((opcode & 0x00FF) == 0x00EE) return Op::RET;
+        if ((opcode & 0x00F0) == 0x00C0) return Op::SCD;
+        if ((opcode & 0x00F0) == 0x00D0) return Op::SCU;
+        if ((opcode & 0x00FF) == 0x00FB) return Op::SCR;
+        if ((opcode & 0x00FF) == 0x00FC) return Op::SCL;
+        if ((opcode & 0x00FF) == 0x00FE) return Op::LOW;
+        if ((opcode & 0x00FF) == 0x00FF) return Op::HIGH;
+        return Op::ILLEGAL;
+    case(0x1000): return Op::JP;
+    case(0x2000): return Op::CALL;
+    case(0x3000): return Op::SE_NN;
+    case(0x4000): return Op::SNE_NN;
+    case(0x5000):
+        switch (opcode & 0x000F) {
+        case(0x0): return Op::SE_XY;
+        case(0x2): return Op::SAVE_XY;
+        case(0x3): return Op::LOAD_XY;
+        }
+        return Op::ILLEGAL;
+    case(0x6000): return Op::LD_NN;
+    case(0x7000): return Op::ADD_NN;
+    case(0x8000):
+        switch (opcode & 0x000F) {
+        case(0x0): return Op::LD_XY;
+        case(0x1): return Op::OR;
+        case(0x2): return Op::AND;
+        case(0x3): return Op::XOR;
+        case(0x4): return Op::ADD_XY;
+        case(0x5): return Op::SUB;
+        case(0x6): return Op::SHR;
+        case(0x7): return Op::SUBN;
+        case(0xE): return Op::SHL;
+        }
+        return Op::ILLEGAL;
+    case(0x9000): return Op::SNE_XY;
+    case(0xA000): return Op::LD_I;
+    case(0xB000): return Op::JP_V0;
+    case(0xC000): return Op::RND;
+    case(0xD000): return Op::DRW;
+    case(0xE000):
+        if ((opcode & 0x00FF) == 0x009E) return Op::SKP;
+        if ((opcode & 0x00FF) == 0x00A1) return Op::SKNP;
+        return Op::ILLEGAL;
+    default:
+        switch (opcode & 0x00FF) {
+        case(0x00): return opcode == 0xF000 ? Op::LD_I_LONG : Op::ILLEGAL;
+        case(0x01): return (opcode & 0x0F00) <= 0x0300 ? Op::PLANE : Op::ILLEGAL;
+        case(0x02): return opcode == 0xF002 ? Op::AUDIO : Op::ILLEGAL;
+        case(0x07): return Op::LD_X_DT;
+        case(0x0A): return Op::LD_X_K;
+        case(0x15): return Op::LD_DT;
+        case(0x18): return Op::LD_ST;
+        case(0x1E): return Op::ADD_I;
+        case(0x29): return Op::LD_F;
+        case(0x30): return Op::LD_HF;
+        case(0x33): return Op::LD_B;
+        case(0x3A): return Op::PITCH;
+        case(0x55): return Op::LD_MEM;
+        case(0x65): return Op::LD_X_MEM;
+        case(0x75): return Op::LD_R;
+        case(0x85): return Op::LD_X_R;
+        }
+        return Op::ILLEGAL;
+    }
+}
+
+// Conditional skips: execution continues at pc + 2 or pc + 4
+inline bool is_skip(Op op) {
+    return op == Op::SE_NN || op == Op::SNE_NN || op == Op::SE_XY || op == Op::SNE_XY
+        || op == Op::SKP || op == Op::SKNP;
+}
+
+// The first variant that executes op; DXY0 is DRW, 16x16 from SuperChip on
+inline Variant op_variant(Op op) {
+    if (op >= Op::SCU && op <= Op::PITCH)
+        return Variant::XoChip;
+    return op >= Op::SCD && op <= Op::LD_X_R ? Variant::SuperChip : Variant::Chip8;
+}
+
+// Instruction size in bytes; F000 is followed by its 16-bit address
+inline int op_length(Op op) {
+    return op == Op::LD_I_LONG ? 4 : 2;
+}
+
+const char* op_pattern(Op op);  // "8XY4", "illegal"
+// Assembly text for one instruction, e.g. "ADD V1, V2"
+void format_instruction(uint16_t opcode, char* out, size_t size);
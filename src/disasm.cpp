@@ -0,0 +1,422 @@
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+#include "chip8.hpp"
+#include "decode.hpp"
+#include "disasm.hpp"
+#include "rom.hpp"
+
+// V0 is at most 255, so a BNNN table has at most 128 two-byte entries
+#define MAX_JUMP_TABLE 128
+
+static uint16_t fetch(const uint8_t* memory, int addr) {
+    return memory[addr & 0xFFF] << 8 | memory[(addr + 1) & 0xFFF];
+}
+
+static bool ends_block(Op op) {
+    return op == Op::JP || op == Op::CALL || op == Op::RET || op == Op::JP_V0 || op == Op::ILLEGAL || is_skip(op);
+}
+
+// Where execution continues after the instruction at addr; a CALL continues
+// at its return address, the callee is handled separately
+static void successors(const uint8_t* memory, const Analysis& a, uint16_t addr, std::vector<uint16_t>& out) {
+    uint16_t opcode = fetch(memory, addr);
+    Op op = decode(opcode);
+    switch (op) {
+    case Op::JP:
+        out.push_back(opcode & 0x0FFF);
+        break;
+    case Op::RET:
+    case Op::ILLEGAL:
+        break;
+    case Op::JP_V0: {
+        auto table = a.jump_tables.find(addr);
+        if (table != a.jump_tables.end())
+            out.insert(out.end(), table->second.begin(), table->second.end());
+        break;
+    }
+    default:
+        out.push_back(addr + op_length(op));
+        // Only XO-CHIP skips all of F000 NNNN, see Chip8::skip_length()
+        if (is_skip(op) && a.variant == Variant::XoChip)
+            out.push_back(addr + 2 + op_length(decode(fetch(memory, addr + 2))));
+        else if (is_skip(op))
+            out.push_back(addr + 4);
+        break;
+    }
+}
+
+static void find_jump_table(const uint8_t* memory, Analysis& a, uint16_t addr, uint16_t base) {
+    std::vector<uint16_t>& targets = a.jump_tables[addr];
+    for (int i = 0; i < MAX_JUMP_TABLE; i++) {
+        int entry = base + 2 * i;
+        if (entry < 0x200 || entry >= a.end || decode(fetch(memory, entry)) != Op::JP)
+            break;
+        targets.push_back(entry);
+    }
+    if (targets.empty())
+        targets.push_back(base);
+}
+
+static void discover(const uint8_t* memory, Analysis& a) {
+    std::vector<uint16_t> work = {0x200};
+    a.subroutines.insert(0x200);
+    while (!work.empty()) {
+        uint16_t addr = work.back();
+        work.pop_back();
+        if (addr < 0x200 || addr >= a.end) {
+            a.external.insert(addr);
+            continue;
+        }
+        if (a.instruction[addr])
+            continue;
+        uint16_t opcode = fetch(memory, addr);
+        uint16_t nnn = opcode & 0x0FFF;
+        Op op = decode(opcode);
+        a.instruction[addr] = true;
+        for (int i = 0; i < op_length(op); i++) {
+            a.code[(addr + i) & 0xFFF] = true;
+        }
+
+        switch (op) {
+        case Op::CALL:
+            if (nnn >= 0x200 && nnn < a.end)
+                a.subroutines.insert(nnn);
+            work.push_back(nnn);
+            break;
+        case Op::LD_I:
+            a.sprites.insert(nnn);
+            break;
+        case Op::JP_V0:
+            find_jump_table(memory, a, addr, nnn);
+            break;
+        default:
+            break;
+        }
+        successors(memory, a, addr, work);
+    }
+
+    // Only data in the ROM gets a sprite label
+    for (auto it = a.sprites.begin(); it != a.sprites.end();) {
+        if (*it < 0x200 || *it >= a.end || a.code[*it])
+            it = a.sprites.erase(it);
+        else
+            ++it;
+    }
+}
+
+static void build_blocks(const uint8_t* memory, Analysis& a) {
+    std::set<uint16_t> leaders(a.subroutines.begin(), a.subroutines.end());
+    std::vector<uint16_t> next;
+    for (int addr = 0x200; addr < a.end; addr++) {
+        if (!a.instruction[addr] || !ends_block(decode(fetch(memory, addr))))
+            continue;
+        next.clear();
+        successors(memory, a, addr, next);
+        leaders.insert(next.begin(), next.end());
+    }
+
+    for (uint16_t leader : leaders) {
+        if (leader >= a.end || !a.instruction[leader])
+            continue;
+        BasicBlock block;
+        block.start = leader;
+        uint16_t addr = leader;
+        while (!ends_block(decode(fetch(memory, addr)))) {
+            uint16_t following = addr + op_length(decode(fetch(memory, addr)));
+            if (following >= a.end || !a.instruction[following] || leaders.count(following))
+                break;
+            addr = following;
+        }
+        block.last = addr;
+        block.end = addr + op_length(decode(fetch(memory, addr)));
+
+        next.clear();
+        successors(memory, a, addr, next);
+        for (uint16_t target : next) {
+            if (target < a.end && a.instruction[target])
+                block.succs.push_back(target);
+        }
+        uint16_t opcode = fetch(memory, addr);
+        if (decode(opcode) == Op::CALL)
+            block.callee = opcode & 0x0FFF;
+        a.blocks[leader] = block;
+    }
+}
+
+static void assign_subroutines(Analysis& a) {
+    // Entry blocks belong to their own subroutine, then each entry claims
+    // whatever it reaches that no earlier entry has
+    for (uint16_t entry : a.subroutines) {
+        a.blocks[entry].subroutine = entry;
+    }
+    for (uint16_t entry : a.subroutines) {
+        std::vector<uint16_t> work(a.blocks[entry].succs);
+        while (!work.empty()) {
+            BasicBlock& block = a.blocks[work.back()];
+            work.pop_back();
+            if (block.subroutine != 0)
+                continue;
+            block.subroutine = entry;
+            work.insert(work.end(), block.succs.begin(), block.succs.end());
+        }
+    }
+}
+
+static void find_loops(Analysis& a) {
+    // Iterative depth-first walk; an edge to a block still on the stack is a back edge
+    std::map<uint16_t, int> state;  // 0 unvisited, 1 on the stack, 2 done
+    for (uint16_t entry : a.subroutines) {
+        if (state[entry] != 0)
+            continue;
+        std::vector<std::pair<uint16_t, size_t>> stack = {{entry, 0}};
+        state[entry] = 1;
+        while (!stack.empty()) {
+            uint16_t start = stack.back().first;
+            const BasicBlock& block = a.blocks[start];
+            if (stack.back().second == block.succs.size()) {
+                state[start] = 2;
+                stack.pop_back();
+                continue;
+            }
+            uint16_t succ = block.succs[stack.back().second++];
+            if (state[succ] == 1) {
+                a.blocks[succ].back_edges.push_back(start);
+            } else if (state[succ] == 0) {
+                state[succ] = 1;
+                stack.push_back({succ, 0});
+            }
+        }
+    }
+}
+
+void analyze(const uint8_t* memory, long rom_size, Variant variant, Analysis& out) {
+    // Jumps and calls reach 0xFFF at most; XO-CHIP ROMs keep data above it
+    out.end = std::min(0x200 + rom_size, 4096L);
+    out.variant = variant;
+    discover(memory, out);
+    build_blocks(memory, out);
+    assign_subroutines(out);
+    find_loops(out);
+}
+
+Variant detect_variant(const uint8_t* memory, long rom_size) {
+    if (rom_size > MAX_ROM_SIZE)
+        return Variant::XoChip;
+    // A skip over F000 reaches it either way, and then the ROM is XO-CHIP
+    Analysis a;
+    analyze(memory, rom_size, Variant::XoChip, a);
+    Variant variant = Variant::Chip8;
+    for (int addr = 0x200; addr < a.end; addr++) {
+        if (a.instruction[addr]) {
+            Variant needs = op_variant(decode(fetch(memory, addr)));
+            if (needs > variant)
+                variant = needs;
+        }
+    }
+    return variant;
+}
+
+static std::string label(const Analysis& a, uint16_t addr) {
+    char buf[16];
+    if (addr == 0x200)
+        return "main";
+    if (a.subroutines.count(addr))
+        snprintf(buf, sizeof(buf), "sub_%03X", addr);
+    else if (a.blocks.count(addr))
+        snprintf(buf, sizeof(buf), "L%03X", addr);
+    else if (a.sprites.count(addr))
+        snprintf(buf, sizeof(buf), "sprite_%03X", addr);
+    else
+        snprintf(buf, sizeof(buf), "0x%03X", addr);
+    return buf;
+}
+
+static std::string annotation(const uint8_t* memory, const Analysis& a, uint16_t addr) {
+    uint16_t opcode = fetch(memory, addr);
+    uint16_t nnn = opcode & 0x0FFF;
+    std::string text;
+    switch (decode(opcode)) {
+    case Op::JP:
+    case Op::CALL:
+        text = label(a, nnn);
+        if (nnn < 0x200 || nnn >= a.end)
+            text += " (outside the ROM)";
+        break;
+    case Op::LD_I:
+        if (a.sprites.count(nnn))
+            text = label(a, nnn);
+        break;
+    case Op::JP_V0: {
+        const std::vector<uint16_t>& targets = a.jump_tables.at(addr);
+        text = targets.size() == 1 && decode(fetch(memory, targets[0])) != Op::JP ? "candidate " : "table ";
+        for (size_t i = 0; i < targets.size(); i++) {
+            text += (i == 0 ? "" : ", ") + label(a, targets[i]);
+        }
+        break;
+    }
+    case Op::LD_I_LONG: {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "0x%04X", fetch(memory, addr + 2));
+        text = buf;
+        break;
+    }
+    case Op::ILLEGAL:
+        text = "traps";
+        break;
+    default:
+        break;
+    }
+    return text;
+}
+
+static void block_header(FILE* out, const Analysis& a, const BasicBlock& block) {
+    fprintf(out, "\n%s:", label(a, block.start).c_str());
+    if (!block.back_edges.empty()) {
+        fprintf(out, "%*s; loop head, back edge from", (int) (30 - label(a, block.start).size()), "");
+        for (uint16_t from : block.back_edges) {
+            fprintf(out, " %s", label(a, from).c_str());
+        }
+    }
+    fprintf(out, "\n");
+}
+
+void write_listing(FILE* out, const uint8_t* memory, const Analysis& a) {
+    int instructions = 0;
+    int data = 0;
+    int loops = 0;
+    for (int addr = 0x200; addr < a.end; addr++) {
+        instructions += a.instruction[addr];
+        data += !a.code[addr];
+    }
+    for (const auto& block : a.blocks) {
+        loops += !block.second.back_edges.empty();
+    }
+    fprintf(out, "; instructions %d, blocks %zu, subroutines %zu, loops %d, jump tables %zu, data bytes %d\n",
+            instructions, a.blocks.size(), a.subroutines.size(), loops, a.jump_tables.size(), data);
+    if (!a.external.empty()) {
+        fprintf(out, "; control leaves the ROM at");
+        for (uint16_t addr : a.external) {
+            fprintf(out, " 0x%03X", addr);
+        }
+        fprintf(out, "\n");
+    }
+
+    char text[32];
+    for (int addr = 0x200; addr < a.end;) {
+        auto block = a.blocks.find(addr);
+        if (block != a.blocks.end())
+            block_header(out, a, block->second);
+
+        if (a.instruction[addr]) {
+            uint16_t opcode = fetch(memory, addr);
+            format_instruction(opcode, text, sizeof(text));
+            std::string note = annotation(memory, a, addr);
+            if (addr + 1 < a.end && a.instruction[addr + 1])
+                note += (note.empty() ? "" : ", ") + std::string("overlaps the next instruction");
+            if (note.empty())
+                fprintf(out, "  %03X  %04X  %s\n", addr, opcode, text);
+            else
+                fprintf(out, "  %03X  %04X  %-18s; %s\n", addr, opcode, text, note.c_str());
+            addr += op_length(decode(opcode));
+            continue;
+        }
+
+        // Data, one byte per line so sprites read as pixels
+        if (a.sprites.count(addr))
+            fprintf(out, "\n%s:\n", label(a, addr).c_str());
+        else if (addr == 0x200 || a.code[addr - 1])
+            fprintf(out, "\n; data\n");
+        uint8_t byte = memory[addr];
+        char pixels[9];
+        for (int bit = 0; bit < 8; bit++) {
+            pixels[bit] = byte & (0x80 >> bit) ? '#' : '.';
+        }
+        pixels[8] = '\0';
+        fprintf(out, "  %03X  %02X    DB 0x%02X           ; %s\n", addr, byte, byte, pixels);
+        addr++;
+    }
+}
+
+void write_dot(FILE* out, const uint8_t* memory, const Analysis& a) {
+    char text[32];
+    fprintf(out, "digraph chip8 {\n");
+    fprintf(out, "    node [shape=box, fontname=\"monospace\"];\n");
+    for (uint16_t entry : a.subroutines) {
+        fprintf(out, "    subgraph cluster_%03X {\n", entry);
+        fprintf(out, "        label=\"%s\";\n", label(a, entry).c_str());
+        for (const auto& it : a.blocks) {
+            const BasicBlock& block = it.second;
+            if (block.subroutine != entry)
+                continue;
+            std::string body = label(a, block.start) + ":\\l";
+            for (int addr = block.start; addr < block.end; addr += op_length(decode(fetch(memory, addr)))) {
+                format_instruction(fetch(memory, addr), text, sizeof(text));
+                char line[48];
+                snprintf(line, sizeof(line), "%03X  %s\\l", addr, text);
+                body += line;
+            }
+            fprintf(out, "        b%03X [label=\"%s\"%s];\n", block.start, body.c_str(),
+                    block.back_edges.empty() ? "" : ", penwidth=2");
+        }
+        fprintf(out, "    }\n");
+    }
+
+    for (const auto& it : a.blocks) {
+        const BasicBlock& block = it.second;
+        Op last = decode(fetch(memory, block.last));
+        for (size_t i = 0; i < block.succs.size(); i++) {
+            uint16_t succ = block.succs[i];
+            const std::vector<uint16_t>& back = a.blocks.at(succ).back_edges;
+            std::string attrs;
+            if (is_skip(last) && i == 1)
+                attrs = "label=\"skip\"";
+            else if (last == Op::JP_V0)
+                attrs = "style=dotted";
+            if (std::find(back.begin(), back.end(), block.start) != back.end())
+                attrs += std::string(attrs.empty() ? "" : ", ") + "color=red";
+            fprintf(out, "    b%03X -> b%03X%s%s%s;\n", block.start, succ, attrs.empty() ? "" : " [",
+                    attrs.c_str(), attrs.empty() ? "" : "]");
+        }
+        if (block.callee != 0 && a.blocks.count(block.callee))
+            fprintf(out, "    b%03X -> b%03X [style=dashed, label=\"call\"];\n", block.start, block.callee);
+    }
+    fprintf(out, "}\n");
+}
+
+int disasm(int argc, char** argv) {
+    const char* rom_path = NULL;
+    const char* dot_path = NULL;
+    for (int i = 0; i < argc; i++) {
+        if (!strcmp(argv[i], "--dot") && i + 1 < argc) {
+            dot_path = argv[++i];
+        } else {
+            rom_path = argv[i];
+        }
+    }
+    if (rom_path == NULL) {
+        fprintf(stderr, "Usage: ./chip8 disasm [--dot cfg.dot] <ROM>\n");
+        return 1;
+    }
+
+    RomImage rom;
+    if (!rom.open(rom_path)) {
+        return 1;
+    }
+    Analysis analysis;
+    analyze(rom.image(), rom.size(), rom.variant(), analysis);
+    printf("; %s: %ld bytes, %s\n", rom_path, rom.size(), variant_name(rom.variant()));
+    write_listing(stdout, rom.image(), analysis);
+
+    if (dot_path != NULL) {
+        FILE* out = fopen(dot_path, "w");
+        if (out == NULL) {
+            fprintf(stderr, "Failed to write %s\n", dot_path);
+            return 1;
+        }
+        write_dot(out, rom.image(), analysis);
+        fclose(out);
+    }
+    return 0;
+}
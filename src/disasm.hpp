@@ -0,0 +1,62 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "decode.hpp"
+
+/*
+  Static disassembler and control-flow analysis.
+
+  analyze() walks the ROM recursively from 0x200 with decode(), following
+  jumps, calls, skips and returns, so bytes count as code only when some
+  path reaches them; the rest of the ROM is data, and data an ANNN points at
+  is labelled as a sprite. Reachable code is split into basic blocks, each
+  block is assigned to a subroutine (0x200 or a CALL target), and back edges
+  found by a depth-first walk mark loop heads.
+
+  BNNN is the only indirect jump. If NNN starts a run of 1NNN instructions
+  the run is taken as a jump table and every entry is followed; otherwise NNN
+  itself is kept as the one candidate target. Code reached only through
+  self-modification is invisible here. Skips step over a following F000
+  NNNN as one instruction only when analyzing for XO-CHIP, as in the VM.
+
+  detect_variant() runs the same analysis, for XO-CHIP, to pick the
+  instruction set a ROM needs: the newest op_variant() among its reachable instructions, so
+  SUPER-CHIP opcodes sitting in sprite data do not count. ROMs too large for
+  4KB are XO-CHIP without looking; only their first 4KB is analyzed, which
+  is all a 12-bit jump can reach.
+*/
+
+struct BasicBlock {
+    uint16_t start;
+    uint16_t end;                  // one past the last instruction
+    uint16_t last;                 // the last instruction
+    std::vector<uint16_t> succs;   // successor blocks within the subroutine
+    uint16_t callee = 0;           // CALL target when the block ends in a CALL
+    uint16_t subroutine = 0;       // entry of the first subroutine that reaches it
+    std::vector<uint16_t> back_edges;  // blocks that loop back to this one
+};
+
+struct Analysis {
+    uint16_t end;                       // one past the last ROM byte
+    Variant variant;                    // instruction set the ROM runs under
+    bool instruction[4096] = {};        // an instruction starts here
+    bool code[4096] = {};               // byte belongs to some instruction
+    std::map<uint16_t, BasicBlock> blocks;
+    std::set<uint16_t> subroutines;
+    std::map<uint16_t, std::vector<uint16_t>> jump_tables;  // BNNN address -> targets
+    std::set<uint16_t> sprites;         // ANNN targets outside code
+    std::set<uint16_t> external;        // jump or call targets outside the ROM
+};
+
+// memory is a full 4KB image with the ROM at 0x200
+void analyze(const uint8_t* memory, long rom_size, Variant variant, Analysis& out);
+void write_listing(FILE* out, const uint8_t* memory, const Analysis& analysis);
+void write_dot(FILE* out, const uint8_t* memory, const Analysis& analysis);
+Variant detect_variant(const uint8_t* memory, long rom_size);
+
+int disasm(int argc, char** argv);
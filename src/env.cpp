@@ -0,0 +1,90 @@
+#include "env.hpp"
+#include "rng.hpp"
+
+VecEnv::VecEnv(const unsigned char* rom, long rom_size, int num_envs, EnvConfig config) {
+    m_config = config;
+    RomImage image;
+    m_pristine.init();
+    m_valid = image.assign(rom, rom_size) && m_pristine.load_rom(image)
+        && configure_rom(m_pristine, config.romdb);
+    m_envs.assign(num_envs, m_pristine);
+    m_action.assign(num_envs, -1);
+    m_frames.assign(num_envs, 0);
+    m_done.assign(num_envs, 0);
+    m_rng.assign(num_envs, 0);
+}
+
+void VecEnv::set_reward(RewardFn fn, void* user) {
+    m_reward = fn;
+    m_reward_user = user;
+}
+
+void VecEnv::reset(uint64_t seed, uint8_t* obs) {
+    // splitmix64 spreads consecutive seeds across env streams
+    uint64_t x = seed;
+    for (int i = 0; i < num_envs(); i++) {
+        m_rng[i] = splitmix64(x) | 1;
+        m_envs[i].seed(splitmix64(x));
+
+        reset_env(i);
+        observe(i, obs + i * observation_size());
+    }
+}
+
+void VecEnv::reset_env(int env) {
+    // Keep the env's CXNN stream running so later episodes differ
+    uint32_t rng[4];
+    memcpy(rng, m_envs[env].rng, sizeof(rng));
+    m_envs[env] = m_pristine;
+    memcpy(m_envs[env].rng, rng, sizeof(rng));
+    m_action[env] = -1;
+    m_frames[env] = 0;
+    m_done[env] = 0;
+}
+
+void VecEnv::observe(int env, uint8_t* obs) {
+    if (m_config.bitpacked)
+        m_envs[env].pack_gfx(obs);
+    else
+        m_envs[env].copy_lores(obs);
+}
+
+bool VecEnv::sticky(int env) {
+    if (m_config.sticky_prob <= 0)
+        return false;
+    // xorshift64
+    uint64_t& s = m_rng[env];
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return (s >> 40) * (1.0f / (1 << 24)) < m_config.sticky_prob;
+}
+
+void VecEnv::step(const int* actions, uint8_t* obs, float* rewards, uint8_t* dones) {
+    for (int i = 0; i < num_envs(); i++) {
+        Chip8& vm = m_envs[i];
+        if (m_done[i])
+            reset_env(i);
+
+        int action = actions[i];
+        if (action < -1 || action > 15)
+            action = -1;
+        if (!sticky(i) && action != m_action[i]) {
+            if (m_action[i] >= 0)
+                vm.set_key(m_action[i], false);
+            if (action >= 0)
+                vm.set_key(action, true);
+            m_action[i] = action;
+        }
+
+        for (int f = 0; f < m_config.frame_skip && !vm.trapped; f++) {
+            vm.emulate_frame();
+            m_frames[i]++;
+        }
+
+        rewards[i] = m_reward ? m_reward(vm, i, m_reward_user) : 0.0f;
+        m_done[i] = vm.trapped || (m_config.max_frames > 0 && m_frames[i] >= m_config.max_frames);
+        dones[i] = m_done[i];
+        observe(i, obs + i * observation_size());
+    }
+}
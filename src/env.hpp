@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+
+#include "chip8.hpp"
+
+/*
+  Vectorized reinforcement-learning environment.
+
+  A batch of environments over one ROM with a gym-shaped API:
+
+      VecEnv env(rom, rom_size, 64);
+      if (!env.valid()) ...
+      env.reset(seed, obs);
+      env.step(actions, obs, rewards, dones);
+
+  Observations are written into a caller-provided buffer of
+  num_envs() * observation_size() bytes: the 64x32 framebuffer, one byte per
+  pixel, or 256 bytes per env when bit-packed. An action is the keypad key to
+  hold for the step (0-15) or -1 for none. Stepping never allocates.
+
+  An env that reports done is reset from the pristine image at the start of
+  its next step. The ROM runs with the variant it needs and its ROM database
+  profile, as in the emulator. If the ROM does not fit memory or the ROM
+  database cannot be read, the constructor prints why and valid() is false.
+*/
+
+struct EnvConfig {
+    int frame_skip = 4;        // frames the action is held for each step
+    float sticky_prob = 0.25f; // chance the previous action repeats instead of the new one
+    bool bitpacked = false;    // 8 pixels per observation byte
+    long max_frames = 0;       // truncate episodes after this many frames; 0 = no limit
+    const char* romdb = NULL;  // ROM database for quirks and cycles, NULL reads CHIP8_ROMDB
+};
+
+// Reward hook, called once per env per step after the frames have run
+typedef float (*RewardFn)(const Chip8& vm, int env, void* user);
+
+class VecEnv {
+public:
+    VecEnv(const unsigned char* rom, long rom_size, int num_envs, EnvConfig config = EnvConfig());
+    bool valid() const { return m_valid; }  // false if the ROM failed to load
+    void set_reward(RewardFn fn, void* user);
+    void reset(uint64_t seed, uint8_t* obs);
+    void step(const int* actions, uint8_t* obs, float* rewards, uint8_t* dones);
+
+    int num_envs() const { return (int) m_envs.size(); }
+    size_t observation_size() const { return m_config.bitpacked ? 64*32 / 8 : 64*32; }
+    const Chip8& vm(int env) const { return m_envs[env]; }
+
+private:
+    void reset_env(int env);
+    void observe(int env, uint8_t* obs);
+    bool sticky(int env);
+
+    EnvConfig m_config;
+    bool m_valid;
+    RewardFn m_reward = NULL;
+    void* m_reward_user = NULL;
+    Chip8 m_pristine;                // initialized and loaded once; resets copy it
+    std::vector<Chip8> m_envs;
+    std::vector<int> m_action;       // action currently held
+    std::vector<long> m_frames;      // frames into the current episode
+    std::vector<uint8_t> m_done;
+    std::vector<uint64_t> m_rng;     // per-env state for sticky actions
+};
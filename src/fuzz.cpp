@@ -0,0 +1,86 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8.hpp"
+#ifdef FUZZ_ORACLE
+#include "oracle.hpp"
+#endif
+
+/*
+  libFuzzer target: the first input byte picks the configuration and the
+  rest is the ROM. Bits 0-1 of that byte raise the variant (1 SUPER-CHIP,
+  2 or 3 XO-CHIP) the same way a ROM database entry does, bit 2 sets the
+  shift_vy quirk and bit 3 load_store_inc. The ROM is loaded and run for a
+  bounded number of cycles with keys toggling, so FX0A and EX9E/EXA1 paths
+  are reached. Bad programs end in a trap rather than exit(), keeping the fuzzer
+  in-process. Build with -DCHIP8_FUZZ=ON using clang, then
+    ./chip8_fuzz -close_fd_mask=2 corpus/
+
+  chip8_fuzz_oracle is the same target built with FUZZ_ORACLE: it runs the
+  batch engine against the reference in lockstep and aborts on the first
+  divergence, so libFuzzer saves the input. The batch engine only runs
+  CHIP-8, so inputs that select or need a later variant are skipped there.
+*/
+
+#define FUZZ_MAX_CYCLES 10000
+
+// Splits off the configuration byte; false if no ROM is left
+static bool fuzz_input(const uint8_t* data, size_t size, RomImage& rom, RomProfile& profile) {
+    if (size < 2)
+        return false;
+    static const Variant variants[4] = {Variant::Chip8, Variant::SuperChip, Variant::XoChip, Variant::XoChip};
+    profile.variant = variants[data[0] & 3];
+    profile.quirks.shift_vy = (data[0] & 0x4) != 0;
+    profile.quirks.load_store_inc = (data[0] & 0x8) != 0;
+    return rom.assign(data + 1, (long) size - 1);
+}
+
+#ifdef FUZZ_ORACLE
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    // Fresh engines per input, as in the plain target
+    ReferenceEngine reference;
+    BatchEngine candidate;
+    Oracle oracle(reference, candidate);
+    RomImage rom;
+    RomProfile profile;
+    if (!fuzz_input(data, size, rom, profile))
+        return 0;
+    if (!oracle.load(rom, 0, profile)) {
+        if (oracle.report().empty() || oracle.unsupported())
+            return 0;
+        fprintf(stderr, "%s", oracle.report().c_str());
+        abort();
+    }
+
+    // Same key schedule as the plain target, in 64-instruction runs
+    for (int i = 0; i < FUZZ_MAX_CYCLES && !oracle.trapped(); i += 64) {
+        oracle.set_key((i >> 6) & 0xF, (i >> 10) & 1);
+        if (!oracle.run(64)) {
+            fprintf(stderr, "%s", oracle.report().c_str());
+            abort();
+        }
+    }
+    return 0;
+}
+#else
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    // A fresh VM per input: RPL flags survive init(), and a crash has to
+    // reproduce from its input alone
+    Chip8 vm;
+    RomImage rom;
+    RomProfile profile;
+    if (!fuzz_input(data, size, rom, profile))
+        return 0;
+    vm.init();
+    vm.seed(0);
+    vm.load_rom(rom);
+    vm.set_profile(profile);
+
+    for (int i = 0; i < FUZZ_MAX_CYCLES && !vm.trapped; i++) {
+        if ((i & 63) == 0)
+            vm.set_key((i >> 6) & 0xF, (i >> 10) & 1);
+        vm.emulate_cycle();
+    }
+    return 0;
+}
+#endif
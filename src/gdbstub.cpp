@@ -0,0 +1,493 @@
+#include "gdbstub.hpp"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "decode.hpp"
+
+#define NUM_REGISTERS 21
+#define MAX_PACKET 4096
+
+// Signals for stop replies
+#define GDB_SIGINT 2
+#define GDB_SIGILL 4
+#define GDB_SIGTRAP 5
+#define GDB_SIGSEGV 11
+
+static const int register_bytes[NUM_REGISTERS] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // V0-VF
+    2, 2, 2,                                         // I, pc, sp
+    1, 1,                                            // dt, st
+};
+
+static std::string target_xml() {
+    std::string xml = "<?xml version=\"1.0\"?>\n"
+                      "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+                      "<target version=\"1.0\">\n"
+                      "  <feature name=\"org.chip8.core\">\n";
+    char line[96];
+    for (int i = 0; i < 16; i++) {
+        snprintf(line, sizeof(line), "    <reg name=\"v%x\" bitsize=\"8\" type=\"uint8\" regnum=\"%d\"/>\n", i, i);
+        xml += line;
+    }
+    xml += "    <reg name=\"i\" bitsize=\"16\" type=\"data_ptr\"/>\n"
+           "    <reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>\n"
+           "    <reg name=\"sp\" bitsize=\"16\" type=\"uint16\"/>\n"
+           "    <reg name=\"dt\" bitsize=\"8\" type=\"uint8\"/>\n"
+           "    <reg name=\"st\" bitsize=\"8\" type=\"uint8\"/>\n"
+           "  </feature>\n"
+           "</target>\n";
+    return xml;
+}
+
+static std::string signal_reply(int signal) {
+    char reply[8];
+    snprintf(reply, sizeof(reply), "S%02x", signal);
+    return reply;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static void append_hex(std::string& out, uint8_t byte) {
+    static const char digits[] = "0123456789abcdef";
+    out += digits[byte >> 4];
+    out += digits[byte & 0xF];
+}
+
+// Little-endian hex of 'bytes' bytes, as register values are sent
+static uint32_t parse_le(const char* hex, int bytes, bool* ok) {
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        int hi = hex_digit(hex[2 * i]);
+        int lo = hi < 0 ? -1 : hex_digit(hex[2 * i + 1]);
+        if (lo < 0) {
+            *ok = false;
+            return 0;
+        }
+        value |= (uint32_t) (hi << 4 | lo) << (8 * i);
+    }
+    *ok = true;
+    return value;
+}
+
+GdbStub::~GdbStub() {
+    close();
+}
+
+bool GdbStub::listen(int port) {
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    m_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    if (m_listen_fd >= 0)
+        setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (m_listen_fd < 0 || bind(m_listen_fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close();
+        return false;
+    }
+    if (::listen(m_listen_fd, 1) < 0) {
+        perror("listen");
+        close();
+        return false;
+    }
+    fcntl(m_listen_fd, F_SETFL, fcntl(m_listen_fd, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+void GdbStub::close() {
+    detach();
+    if (m_listen_fd >= 0) {
+        ::close(m_listen_fd);
+        m_listen_fd = -1;
+    }
+}
+
+void GdbStub::detach() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_in.clear();
+    m_no_ack = false;
+    m_running = false;
+    m_breakpoints.reset();
+    m_watch_write.reset();
+    m_watch_read.reset();
+    m_watch_access.reset();
+}
+
+void GdbStub::poll(Chip8& vm) {
+    if (m_listen_fd < 0)
+        return;
+
+    if (m_fd < 0) {
+        m_fd = accept(m_listen_fd, NULL, NULL);
+        if (m_fd < 0)
+            return;
+        // Reads are non-blocking, replies are small and sent blocking
+        int on = 1;
+        setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+#ifdef SO_NOSIGPIPE
+        setsockopt(m_fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        m_running = false;
+        fprintf(stderr, "Debugger attached at pc 0x%03X\n", vm.pc);
+    }
+
+    char buf[1024];
+    ssize_t n;
+    while ((n = recv(m_fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+        m_in.append(buf, n);
+    }
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        fprintf(stderr, "Debugger detached\n");
+        detach();
+        return;
+    }
+
+    while (!m_in.empty() && m_fd >= 0) {
+        char c = m_in[0];
+        if (c == 0x03) {
+            // Ctrl-C from the debugger
+            m_in.erase(0, 1);
+            if (m_running)
+                halt(signal_reply(GDB_SIGINT));
+            continue;
+        }
+        if (c != '$') {
+            // Acks, and anything between packets
+            m_in.erase(0, 1);
+            continue;
+        }
+        size_t end = m_in.find('#');
+        if (end == std::string::npos || end + 2 >= m_in.size()) {
+            if (m_in.size() > MAX_PACKET)
+                m_in.clear();
+            break;
+        }
+        std::string payload = m_in.substr(1, end - 1);
+        int checksum = hex_digit(m_in[end + 1]) << 4 | hex_digit(m_in[end + 2]);
+        m_in.erase(0, end + 3);
+
+        uint8_t sum = 0;
+        for (char p : payload) {
+            sum += (uint8_t) p;
+        }
+        if (!m_no_ack)
+            send_raw(sum == checksum ? "+" : "-");
+        if (sum == checksum)
+            handle_packet(vm, payload);
+    }
+}
+
+void GdbStub::send_raw(const std::string& data) {
+    size_t sent = 0;
+    while (m_fd >= 0 && sent < data.size()) {
+        ssize_t n = send(m_fd, data.data() + sent, data.size() - sent, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            detach();
+            return;
+        }
+        sent += n;
+    }
+}
+
+void GdbStub::send_packet(const std::string& payload) {
+    uint8_t sum = 0;
+    for (char c : payload) {
+        sum += (uint8_t) c;
+    }
+    std::string packet = "$" + payload + "#";
+    append_hex(packet, sum);
+    send_raw(packet);
+}
+
+void GdbStub::halt(const std::string& reason) {
+    m_running = false;
+    send_packet(reason);
+}
+
+std::string GdbStub::read_register(const Chip8& vm, int reg) const {
+    uint32_t value;
+    if (reg < 16)
+        value = vm.V[reg];
+    else if (reg == 16)
+        value = vm.I;
+    else if (reg == 17)
+        value = vm.pc;
+    else if (reg == 18)
+        value = vm.sp;
+    else if (reg == 19)
+        value = vm.delay_timer;
+    else
+        value = vm.sound_timer;
+    std::string out;
+    for (int i = 0; i < register_bytes[reg]; i++) {
+        append_hex(out, (value >> (8 * i)) & 0xFF);
+    }
+    return out;
+}
+
+std::string GdbStub::read_registers(const Chip8& vm) const {
+    std::string out;
+    for (int reg = 0; reg < NUM_REGISTERS; reg++) {
+        out += read_register(vm, reg);
+    }
+    return out;
+}
+
+bool GdbStub::write_register(Chip8& vm, int reg, const char* hex) {
+    if (reg < 0 || reg >= NUM_REGISTERS || strlen(hex) < (size_t) register_bytes[reg] * 2)
+        return false;
+    bool ok;
+    uint32_t value = parse_le(hex, register_bytes[reg], &ok);
+    if (!ok)
+        return false;
+    if (reg < 16)
+        vm.V[reg] = value;
+    else if (reg == 16)
+        vm.I = value;
+    else if (reg == 17)
+        vm.pc = value & (vm.memory.size() - 1);
+    else if (reg == 18)
+        vm.sp = value > 16 ? 16 : value;
+    else if (reg == 19)
+        vm.delay_timer = value;
+    else
+        vm.sound_timer = value;
+    return true;
+}
+
+bool GdbStub::set_point(char type, int addr, int kind, bool insert) {
+    if (type == '0' || type == '1') {
+        // Software and hardware breakpoints are the same bitmap
+        m_breakpoints[addr & 0xFFF] = insert;
+        return true;
+    }
+    std::bitset<4096>* watch = type == '2' ? &m_watch_write : type == '3' ? &m_watch_read
+                             : type == '4' ? &m_watch_access : NULL;
+    if (watch == NULL)
+        return false;
+    for (int i = 0; i < kind && i < 4096; i++) {
+        (*watch)[(addr + i) & 0xFFF] = insert;
+    }
+    return true;
+}
+
+void GdbStub::handle_packet(Chip8& vm, const std::string& packet) {
+    const char* p = packet.c_str();
+    static const char xfer[] = "qXfer:features:read:target.xml:";
+    char reply[128];
+    switch (p[0]) {
+    case '?':
+        send_packet(signal_reply(GDB_SIGTRAP));
+        break;
+    case 'g':
+        send_packet(read_registers(vm));
+        break;
+    case 'G': {
+        const char* hex = p + 1;
+        for (int reg = 0; reg < NUM_REGISTERS; reg++) {
+            if (!write_register(vm, reg, hex)) {
+                send_packet("E01");
+                return;
+            }
+            hex += register_bytes[reg] * 2;
+        }
+        send_packet("OK");
+        break;
+    }
+    case 'p': {
+        int reg = strtol(p + 1, NULL, 16);
+        send_packet(reg >= 0 && reg < NUM_REGISTERS ? read_register(vm, reg) : "E01");
+        break;
+    }
+    case 'P': {
+        char* value;
+        int reg = strtol(p + 1, &value, 16);
+        send_packet(*value == '=' && write_register(vm, reg, value + 1) ? "OK" : "E01");
+        break;
+    }
+    case 'm': {
+        char* rest;
+        int addr = strtol(p + 1, &rest, 16);
+        int len = *rest == ',' ? strtol(rest + 1, NULL, 16) : 0;
+        if (len <= 0 || len > MAX_PACKET / 2) {
+            send_packet("E01");
+            break;
+        }
+        std::string out;
+        for (int i = 0; i < len; i++) {
+            append_hex(out, vm.memory[(addr + i) & (vm.memory.size() - 1)]);
+        }
+        send_packet(out);
+        break;
+    }
+    case 'M': {
+        char* rest;
+        int addr = strtol(p + 1, &rest, 16);
+        int len = *rest == ',' ? strtol(rest + 1, &rest, 16) : -1;
+        if (len < 0 || *rest != ':' || strlen(rest + 1) < (size_t) len * 2) {
+            send_packet("E01");
+            break;
+        }
+        for (int i = 0; i < len; i++) {
+            bool ok;
+            uint8_t byte = parse_le(rest + 1 + 2 * i, 1, &ok);
+            if (!ok) {
+                send_packet("E01");
+                return;
+            }
+            vm.memory[(addr + i) & (vm.memory.size() - 1)] = byte;
+        }
+        send_packet("OK");
+        break;
+    }
+    case 'c':
+        if (p[1] != '\0')
+            vm.pc = strtol(p + 1, NULL, 16) & (vm.memory.size() - 1);
+        m_running = true;
+        m_skip_break = true;
+        break;
+    case 's':
+        if (p[1] != '\0')
+            vm.pc = strtol(p + 1, NULL, 16) & (vm.memory.size() - 1);
+        if (step(vm, false))
+            send_packet(signal_reply(GDB_SIGTRAP));
+        break;
+    case 'Z':
+    case 'z': {
+        int addr = 0;
+        int kind = 0;
+        if (sscanf(p + 1, "%*c,%x,%x", &addr, &kind) != 2 || !set_point(p[1], addr, kind, p[0] == 'Z'))
+            send_packet("");
+        else
+            send_packet("OK");
+        break;
+    }
+    case 'D':
+        send_packet("OK");
+        fprintf(stderr, "Debugger detached\n");
+        detach();
+        break;
+    case 'k':
+        // Never kill the emulator from the debugger; just let the ROM run on
+        fprintf(stderr, "Debugger detached\n");
+        detach();
+        break;
+    case 'H':
+    case 'T':
+        send_packet("OK");
+        break;
+    case 'q':
+    case 'Q':
+        if (!strncmp(p, "qSupported", 10)) {
+            snprintf(reply, sizeof(reply), "PacketSize=%x;qXfer:features:read+;swbreak+;hwbreak+;QStartNoAckMode+",
+                     MAX_PACKET);
+            send_packet(reply);
+        } else if (!strcmp(p, "QStartNoAckMode")) {
+            send_packet("OK");
+            m_no_ack = true;
+        } else if (!strncmp(p, xfer, sizeof(xfer) - 1)) {
+            unsigned offset = 0;
+            unsigned length = 0;
+            sscanf(p + sizeof(xfer) - 1, "%x,%x", &offset, &length);
+            std::string xml = target_xml();
+            if (offset >= xml.size())
+                send_packet("l");
+            else if (offset + length >= xml.size())
+                send_packet("l" + xml.substr(offset));
+            else
+                send_packet("m" + xml.substr(offset, length));
+        } else if (!strcmp(p, "qAttached")) {
+            send_packet("1");
+        } else if (!strcmp(p, "qC")) {
+            send_packet("QC1");
+        } else if (!strcmp(p, "qfThreadInfo")) {
+            send_packet("m1");
+        } else if (!strcmp(p, "qsThreadInfo")) {
+            send_packet("l");
+        } else {
+            send_packet("");
+        }
+        break;
+    default:
+        // Unsupported, including vCont and X; gdb falls back to s/c and M
+        send_packet("");
+        break;
+    }
+}
+
+// Runs one instruction; false if the VM stopped, in which case the stop reply
+// has been sent
+bool GdbStub::step(Chip8& vm, bool check_break) {
+    // Only the bitmap index aliases above 4KB
+    const uint16_t mask = vm.memory.size() - 1;
+    uint16_t pc = vm.pc;
+    if (check_break && m_breakpoints[pc & 0xFFF]) {
+        halt("T05swbreak:;");
+        return false;
+    }
+
+    // Bytes the instruction will touch, for the watchpoints
+    DataAccess access = vm.data_access();
+    char reply[32];
+
+    Status status = vm.emulate_cycle();
+    if (status > Status::WaitingForKey) {
+        halt(signal_reply(status == Status::IllegalOpcode ? GDB_SIGILL : GDB_SIGSEGV));
+        return false;
+    }
+    for (int i = 0; i < access.count; i++) {
+        int addr = (access.addr + i) & mask;
+        const char* kind = NULL;
+        if (m_watch_access[addr & 0xFFF])
+            kind = "awatch";
+        else if (access.writes && m_watch_write[addr & 0xFFF])
+            kind = "watch";
+        else if (!access.writes && m_watch_read[addr & 0xFFF])
+            kind = "rwatch";
+        if (kind != NULL) {
+            snprintf(reply, sizeof(reply), "T%02x%s:%x;", GDB_SIGTRAP, kind, addr);
+            halt(reply);
+            return false;
+        }
+    }
+    return true;
+}
+
+int GdbStub::run_frame(Chip8& vm) {
+    int executed = 0;
+    for (int i = 0; i < vm.cycles_per_frame && m_running; i++) {
+        bool check = !m_skip_break;
+        m_skip_break = false;
+        uint16_t pc = vm.pc;
+        if (!step(vm, check))
+            break;
+        // Count completed instructions like emulate_frame(): FX0A waiting stays on its pc
+        executed += !((vm.opcode & 0xF0FF) == 0xF00A && vm.pc == pc);
+    }
+    // Sticky faults are checked per frame, as in emulate_frame()
+    if (m_running && vm.check_faults() == Status::AddressWrap)
+        halt(signal_reply(GDB_SIGSEGV));
+    return executed;
+}
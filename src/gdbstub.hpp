@@ -0,0 +1,65 @@
+#pragma once
+
+#include <bitset>
+#include <string>
+
+#include "chip8.hpp"
+
+/*
+  GDB remote serial protocol stub on a localhost TCP port (--gdb PORT).
+
+  With no debugger attached the emulator keeps calling emulate_frame() and
+  the stub costs one non-blocking accept per frame. Attaching halts the VM;
+  from then on frames run through run_frame(), which checks the breakpoint
+  bitmap before every instruction and the watchpoint bitmaps for the bytes
+  the instruction is about to touch, as Chip8::data_access() sizes them.
+  Detaching ('D' or 'k') resumes the ROM at full speed; a fault while
+  attached halts instead of exiting. As with the frame stream, a debugger
+  hanging up needs SO_NOSIGPIPE or an ignored SIGPIPE (main ignores it).
+
+  Registers, in 'g' packet order, multi-byte values little-endian:
+    0-15  V0-VF  8 bits
+    16    I      16 bits
+    17    pc     16 bits
+    18    sp     16 bits, stack depth 0-16
+    19    dt     8 bits
+    20    st     8 bits
+  The same layout is served as target.xml. Memory reads and writes wrap at
+  the end of memory (64KB for XO-CHIP); breakpoints and watchpoints cover
+  the 12-bit address space and alias above it.
+*/
+
+class GdbStub {
+public:
+    ~GdbStub();
+    bool listen(int port);
+    // Accept a debugger and handle its packets; call once per frame
+    void poll(Chip8& vm);
+    bool attached() const { return m_fd >= 0; }
+    // Replaces emulate_frame() while attached; returns instructions executed
+    int run_frame(Chip8& vm);
+    void close();
+
+private:
+    void detach();
+    void handle_packet(Chip8& vm, const std::string& packet);
+    void send_packet(const std::string& payload);
+    void send_raw(const std::string& data);
+    bool step(Chip8& vm, bool check_break);
+    void halt(const std::string& reason);
+    std::string read_registers(const Chip8& vm) const;
+    std::string read_register(const Chip8& vm, int reg) const;
+    bool write_register(Chip8& vm, int reg, const char* hex);
+    bool set_point(char type, int addr, int kind, bool insert);
+
+    int m_listen_fd = -1;
+    int m_fd = -1;
+    std::string m_in;
+    bool m_running = false;
+    bool m_no_ack = false;
+    bool m_skip_break = false;  // resuming from a breakpoint: run its instruction first
+    std::bitset<4096> m_breakpoints;
+    std::bitset<4096> m_watch_write;
+    std::bitset<4096> m_watch_read;
+    std::bitset<4096> m_watch_access;
+};
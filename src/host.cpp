@@ -0,0 +1,301 @@
+#include "host.hpp"
+
+#include <algorithm>
+
+Host::Host(unsigned threads) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < threads; i++) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+}
+
+Host::~Host() {
+    stop();
+}
+
+void Host::start() {
+    if (m_running.exchange(true))
+        return;
+    for (unsigned i = 0; i < m_workers.size(); i++) {
+        m_workers[i]->thread = std::thread(&Host::worker_loop, this, i);
+    }
+}
+
+void Host::stop() {
+    if (!m_running.exchange(false))
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_wake_mutex);
+        m_wake_cv.notify_all();
+    }
+    for (auto& worker : m_workers) {
+        worker->thread.join();
+    }
+}
+
+int Host::add_session(const unsigned char* rom, long rom_size, SessionConfig config) {
+    RomImage image;
+    if (!image.assign(rom, rom_size))
+        return -1;
+    return add_session(image, config);
+}
+
+int Host::add_session(const RomImage& rom, SessionConfig config) {
+    auto shared = m_arena.add(rom);
+    auto session = std::make_shared<Session>();
+    session->config = config;
+    session->rom = shared;
+    session->vm.set_variant(rom.variant());
+    session->vm.fatal_faults = config.fatal_faults;
+    session->vm.reset(*shared);
+    session->next_due = Clock::now();
+    {
+        std::lock_guard<std::mutex> lock(m_sessions_mutex);
+        session->id = m_next_id++;
+        m_sessions[session->id] = session;
+    }
+    schedule_at(home(*session), session, session->next_due);
+    return session->id;
+}
+
+void Host::remove_session(int id) {
+    std::lock_guard<std::mutex> lock(m_sessions_mutex);
+    auto it = m_sessions.find(id);
+    if (it == m_sessions.end())
+        return;
+    // Queued references are dropped the next time a worker picks the session up
+    it->second->removed = true;
+    m_sessions.erase(it);
+}
+
+Host::SessionPtr Host::find(int id) {
+    std::lock_guard<std::mutex> lock(m_sessions_mutex);
+    auto it = m_sessions.find(id);
+    return it == m_sessions.end() ? nullptr : it->second;
+}
+
+void Host::reset_session(int id) {
+    SessionPtr session = find(id);
+    if (session == nullptr)
+        return;
+    std::lock_guard<std::mutex> lock(session->mutex);
+    // Parked and trapped sessions are off the run queues; the others are already scheduled
+    bool scheduled = session->state != SessionState::Parked && session->state != SessionState::Trapped;
+    session->vm.reset(*session->rom);
+    session->state = SessionState::Running;
+    session->frames = 0;
+    session->instructions = 0;
+    session->idle_count = 0;
+    session->frames_since_draw = 0;
+    if (!scheduled) {
+        session->next_due = Clock::now();
+        schedule_at(home(*session), session, session->next_due);
+    }
+}
+
+size_t Host::rom_count() {
+    return m_arena.size();
+}
+
+void Host::set_key(int id, int key, bool value) {
+    SessionPtr session = find(id);
+    if (session == nullptr)
+        return;
+    uint16_t bit = 1 << (key & 0xF);
+    if (value)
+        session->keys |= bit;
+    else
+        session->keys &= ~bit;
+
+    // Input wakes a parked session
+    std::lock_guard<std::mutex> lock(session->mutex);
+    if (session->state == SessionState::Parked) {
+        session->state = SessionState::Running;
+        session->idle_count = 0;
+        session->next_due = Clock::now();
+        schedule_at(home(*session), session, session->next_due);
+    }
+}
+
+bool Host::copy_gfx(int id, uint8_t* out) {
+    SessionPtr session = find(id);
+    if (session == nullptr)
+        return false;
+    std::lock_guard<std::mutex> lock(session->mutex);
+    session->vm.copy_lores(out);
+    return true;
+}
+
+bool Host::stats(int id, SessionStats* out) {
+    SessionPtr session = find(id);
+    if (session == nullptr)
+        return false;
+    std::lock_guard<std::mutex> lock(session->mutex);
+    out->state = session->state;
+    out->frames = session->frames;
+    out->instructions = session->instructions;
+    out->fault = session->vm.fault;
+    out->fault_pc = session->vm.fault_pc;
+    out->faults = session->vm.faults;
+    return true;
+}
+
+size_t Host::session_count() {
+    std::lock_guard<std::mutex> lock(m_sessions_mutex);
+    return m_sessions.size();
+}
+
+void Host::worker_loop(unsigned index) {
+    while (m_running) {
+        SessionPtr session = pop_local(index);
+        if (!session)
+            session = steal(index);
+        if (!session) {
+            sleep();
+            continue;
+        }
+        if (session->removed)
+            continue;
+
+        std::lock_guard<std::mutex> lock(session->mutex);
+        run_slice(*session);
+        reschedule(index, session);
+    }
+}
+
+Host::SessionPtr Host::pop_local(unsigned index) {
+    Worker& worker = *m_workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    return take(worker, false);
+}
+
+Host::SessionPtr Host::steal(unsigned index) {
+    for (unsigned i = 1; i < m_workers.size(); i++) {
+        Worker& victim = *m_workers[(index + i) % m_workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        SessionPtr session = take(victim, true);
+        if (session)
+            return session;
+    }
+    return NULL;
+}
+
+// Called with worker.mutex held
+Host::SessionPtr Host::take(Worker& worker, bool thief) {
+    Clock::time_point now = Clock::now();
+    while (!worker.timers.empty() && worker.timers.top().due <= now) {
+        worker.ready.push(worker.timers.top());
+        worker.timers.pop();
+    }
+    SessionPtr session;
+    if (!worker.ready.empty()) {
+        session = worker.ready.top().session;
+        worker.ready.pop();
+    } else if (!worker.queue.empty() && thief) {
+        session = worker.queue.front();
+        worker.queue.pop_front();
+    } else if (!worker.queue.empty()) {
+        session = worker.queue.back();
+        worker.queue.pop_back();
+    }
+    return session;
+}
+
+void Host::sleep() {
+    // Nothing runnable anywhere: sleep until the earliest timer of any worker.
+    // Counting this worker as a sleeper before looking means a session queued
+    // after the look sees the count and wakes it
+    std::unique_lock<std::mutex> lock(m_wake_mutex);
+    m_sleepers++;
+    Clock::time_point wake = Clock::now() + std::chrono::milliseconds(100);
+    bool runnable = false;
+    for (auto& worker : m_workers) {
+        std::lock_guard<std::mutex> worker_lock(worker->mutex);
+        runnable |= !worker->ready.empty() || !worker->queue.empty();
+        if (!worker->timers.empty())
+            wake = std::min(wake, worker->timers.top().due);
+    }
+    if (!runnable && m_running)
+        m_wake_cv.wait_until(lock, wake);
+    m_sleepers--;
+}
+
+void Host::wake_one() {
+    if (m_sleepers == 0)
+        return;
+    std::lock_guard<std::mutex> lock(m_wake_mutex);
+    m_wake_cv.notify_one();
+}
+
+void Host::run_slice(Session& session) {
+    Chip8& vm = session.vm;
+    uint16_t keys = session.keys;
+    for (int i = 0; i < 16; i++) {
+        vm.key[i] = (keys >> i) & 1;
+    }
+
+    vm.drawFlag = false;
+    session.instructions += vm.emulate_frame();
+    session.frames++;
+
+    // A fault stops only this session; the host keeps running the others
+    if (vm.trapped) {
+        session.state = SessionState::Trapped;
+        return;
+    }
+
+    // Idle: blocked on FX0A or spinning on a jump to itself; either way pc is
+    // still on the last instruction
+    const uint16_t mask = vm.memory.size() - 1;
+    uint16_t at_pc = vm.memory[vm.pc & mask] << 8 | vm.memory[(vm.pc + 1) & mask];
+    bool idle = vm.opcode == at_pc && ((vm.opcode & 0xF0FF) == 0xF00A || vm.opcode == (0x1000 | vm.pc));
+    session.idle_count = idle ? session.idle_count + 1 : 0;
+    session.frames_since_draw = vm.drawFlag ? 0 : session.frames_since_draw + 1;
+
+    if (session.idle_count >= session.config.idle_frames)
+        session.state = SessionState::Parked;
+    else if (session.frames_since_draw >= session.config.spin_frames)
+        session.state = SessionState::Throttled;
+    else
+        session.state = SessionState::Running;
+}
+
+// Called with the session mutex held, so a concurrent set_key cannot queue it twice
+void Host::reschedule(unsigned index, const SessionPtr& session) {
+    if (session->removed)
+        return;
+    if (session->state == SessionState::Trapped || session->state == SessionState::Parked)
+        return;
+
+    int fps = session->state == SessionState::Throttled ? session->config.spin_fps
+                                                        : session->config.frames_per_second;
+    if (fps <= 0) {
+        // Unthrottled: back of the line behind this worker's other sessions
+        Worker& worker = *m_workers[index];
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.queue.push_front(session);
+        }
+        wake_one();
+        return;
+    }
+
+    Clock::duration interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / fps));
+    Clock::time_point now = Clock::now();
+    session->next_due += interval;
+    // Drop the backlog rather than running a burst of catch-up frames
+    if (session->next_due + interval < now)
+        session->next_due = now;
+    schedule_at(index, session, session->next_due);
+}
+
+void Host::schedule_at(unsigned index, const SessionPtr& session, Clock::time_point due) {
+    Worker& worker = *m_workers[index];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.timers.push(Timer{due, session->config.priority, session});
+    }
+    wake_one();
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "chip8.hpp"
+
+/*
+  Multi-session VM host.
+
+  Owns many Chip8 instances and steps each one a frame at a time on a pool of
+  worker threads. Each worker owns its sessions: paced ones wait in its timer
+  heap and cost nothing until their next frame, then move to its ready queue,
+  which runs the highest priority first (earliest due among equals) ahead of
+  its unthrottled sessions. A worker that runs dry steals from the others,
+  ready sessions first, and a stolen session stays with the thief, so paced
+  and unthrottled load both balance across cores without a thread per
+  session or a shared queue.
+*/
+
+struct SessionConfig {
+    int frames_per_second = 60;  // pacing; 0 runs the session unthrottled
+    int priority = 0;            // among a worker's sessions that are due, higher runs first
+    int idle_frames = 120;       // park after this many frames blocked on FX0A or a jump-to-self
+    int spin_frames = 600;       // after this many frames without a draw the session is throttled
+    int spin_fps = 10;           // pacing for a throttled session
+    uint8_t fatal_faults = FAULT_WRITE_WRAP;  // sticky faults that stop the session at the end of a frame
+};
+
+enum class SessionState {
+    Running,
+    Throttled,  // spinning without drawing, running at spin_fps
+    Parked,     // idle; woken by set_key
+    Trapped,    // stopped on a fault (see SessionStats::fault); no longer scheduled
+};
+
+struct SessionStats {
+    SessionState state;
+    long frames;
+    long instructions;
+    Status fault;          // why a Trapped session stopped
+    uint16_t fault_pc;
+    uint8_t faults;        // FAULT_* bits since the last reset, fatal or not
+};
+
+class Host {
+public:
+    Host(unsigned threads = 0);
+    ~Host();
+    void start();
+    void stop();
+
+    int add_session(const unsigned char* rom, long rom_size, SessionConfig config = SessionConfig());
+    // Sessions running the same ROM share its memory page until they write to it
+    int add_session(const RomImage& rom, SessionConfig config = SessionConfig());
+    void remove_session(int id);
+    void reset_session(int id);  // restart from the ROM image, without reloading it
+    size_t rom_count();          // distinct ROMs in the arena
+    void set_key(int id, int key, bool value);
+    bool copy_gfx(int id, uint8_t* out);  // 64x32, see Chip8::copy_lores()
+    bool stats(int id, SessionStats* out);
+    size_t session_count();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Session {
+        int id;
+        SessionConfig config;
+        std::atomic<uint16_t> keys{0};    // key state from set_key, applied at the next slice
+        std::atomic<bool> removed{false};
+        std::mutex mutex;                 // held while the session runs; guards the fields below
+        std::shared_ptr<const ArenaRom> rom;
+        Chip8 vm;
+        SessionState state = SessionState::Running;
+        Clock::time_point next_due;
+        long frames = 0;
+        long instructions = 0;
+        int idle_count = 0;
+        int frames_since_draw = 0;
+    };
+    typedef std::shared_ptr<Session> SessionPtr;
+
+    struct Timer {
+        Clock::time_point due;
+        int priority;
+        SessionPtr session;
+        bool operator<(const Timer& other) const {
+            // priority_queue is a max-heap; the earliest timer is on top
+            return due > other.due;
+        }
+    };
+    struct ReadyOrder {
+        bool operator()(const Timer& a, const Timer& b) const {
+            // Highest priority on top, then the earliest due
+            if (a.priority != b.priority)
+                return a.priority < b.priority;
+            return a.due > b.due;
+        }
+    };
+
+    struct Worker {
+        std::mutex mutex;                 // guards the three queues
+        std::priority_queue<Timer> timers;  // paced sessions not yet due
+        std::priority_queue<Timer, std::vector<Timer>, ReadyOrder> ready;  // due, not yet running
+        std::deque<SessionPtr> queue;     // unthrottled; owner pops the back, thieves take the front
+        std::thread thread;
+    };
+
+    void worker_loop(unsigned index);
+    SessionPtr pop_local(unsigned index);
+    SessionPtr steal(unsigned index);
+    SessionPtr take(Worker& worker, bool thief);
+    void sleep();
+    void wake_one();
+    void run_slice(Session& session);
+    void reschedule(unsigned index, const SessionPtr& session);
+    void schedule_at(unsigned index, const SessionPtr& session, Clock::time_point due);
+    unsigned home(const Session& session) const { return session.id % m_workers.size(); }
+    SessionPtr find(int id);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::atomic<bool> m_running{false};
+
+    // Idle workers sleep here until the earliest timer of any worker
+    std::mutex m_wake_mutex;
+    std::condition_variable m_wake_cv;
+    std::atomic<int> m_sleepers{0};
+
+    std::mutex m_sessions_mutex;
+    std::map<int, SessionPtr> m_sessions;
+    int m_next_id = 1;
+
+    RomArena m_arena;
+};
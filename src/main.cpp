@@ -3,56 +3,245 @@
 #include <iostream>
 #include <unistd.h>
 #include <cassert>
+#include <csignal>
 
 #include <SDL2/SDL.h>
 
+#include "batch.hpp"
+#include "disasm.hpp"
+#include "gdbstub.hpp"
 #include "main.hpp"
+#include "metrics.hpp"
+#include "recorder.hpp"
+#include "regress.hpp"
+#include "replay.hpp"
+#include "shm.hpp"
+#include "stream.hpp"
+#include "trace.hpp"
 #include "tests.hpp"
 #include "window.hpp"
 
 using namespace std;
 
-#define NUM_PIXELS 2048
+#define NUM_PIXELS (128*64)
+
+static volatile sig_atomic_t quit_requested = 0;
+
+static volatile sig_atomic_t trace_requested = 0;
+
+// Toggled with F1
+static bool show_hud = false;
+
+static void request_quit(int) {
+    quit_requested = 1;
+}
+
+static void request_trace(int) {
+    trace_requested = 1;
+}
+
+static int usage() {
+    fprintf(stderr, "Usage: ./chip8 [--shm NAME] [--stream unix:PATH|tcp:PORT] [--record out.y4m [--record-scale N]] [--hud] [--metrics-file PATH] [--record-input PATH] [--seed N] [--romdb PATH] [--gdb PORT] [--strict] [path to ROM]\n");
+    fprintf(stderr, "       ./chip8 batch [options] <ROM directory>\n");
+    fprintf(stderr, "       ./chip8 regress [options] <manifest>\n");
+    fprintf(stderr, "       ./chip8 replay [options] <ROM> <input log>\n");
+    fprintf(stderr, "       ./chip8 disasm [--dot cfg.dot] <ROM>\n");
+    fprintf(stderr, "       ./chip8 trace <trace file>\n");
+    return 1;
+}
 
 int main(int argc, char **argv) {
     if (argc == 1) {
-        fprintf(stderr, "Usage: ./chip8 [path to ROM]\n");
-        return 1;
+        return usage();
     }
 
     bool debug = getenv("CHIP8_DEBUG");
     if (!strcmp(*(argv + 1), "test")) {
         return test(debug);
     }
+    if (!strcmp(*(argv + 1), "batch")) {
+        return batch(argc - 2, argv + 2);
+    }
+    if (!strcmp(*(argv + 1), "regress")) {
+        return regress(argc - 2, argv + 2);
+    }
+    if (!strcmp(*(argv + 1), "replay")) {
+        return replay(argc - 2, argv + 2);
+    }
+    if (!strcmp(*(argv + 1), "disasm")) {
+        return disasm(argc - 2, argv + 2);
+    }
+    if (!strcmp(*(argv + 1), "trace")) {
+        if (argc != 3) {
+            fprintf(stderr, "Usage: ./chip8 trace <trace file>\n");
+            return 1;
+        }
+        return trace_dump(argv[2]);
+    }
+
+    const char* rom_path = NULL;
+    const char* shm_name = NULL;
+    const char* stream_address = NULL;
+    const char* record_path = NULL;
+    int record_scale = 4;
+    const char* metrics_path = NULL;
+    const char* input_log_path = NULL;
+    const char* romdb = NULL;
+    int gdb_port = 0;
+    bool strict = false;
+    uint64_t seed = std::chrono::system_clock::now().time_since_epoch().count();
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--shm") && i + 1 < argc) {
+            shm_name = argv[++i];
+        } else if (!strcmp(argv[i], "--stream") && i + 1 < argc) {
+            stream_address = argv[++i];
+        } else if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (!strcmp(argv[i], "--record-scale") && i + 1 < argc) {
+            record_scale = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--hud")) {
+            show_hud = true;
+        } else if (!strcmp(argv[i], "--metrics-file") && i + 1 < argc) {
+            metrics_path = argv[++i];
+        } else if (!strcmp(argv[i], "--record-input") && i + 1 < argc) {
+            input_log_path = argv[++i];
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--romdb") && i + 1 < argc) {
+            romdb = argv[++i];
+        } else if (!strcmp(argv[i], "--gdb") && i + 1 < argc) {
+            gdb_port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--strict")) {
+            strict = true;
+        } else {
+            rom_path = argv[i];
+        }
+    }
+    if (rom_path == NULL) {
+        return usage();
+    }
+
+    Chip8 chip8 = Chip8(debug);
+    chip8.init();
+    if (!chip8.load_file(rom_path) || !configure_rom(chip8, romdb)) {
+        return 1;
+    }
+    chip8.seed(seed);
+    if (strict)
+        chip8.fatal_faults = FAULT_READ_WRAP | FAULT_WRITE_WRAP;
+
+    FrameExport frame_export;
+    if (shm_name != NULL && !frame_export.open(shm_name)) {
+        return 1;
+    }
+    Recorder recorder;
+    if (record_path != NULL && !recorder.open(record_path, record_scale)) {
+        return 1;
+    }
+    InputRecorder input_recorder;
+    if (input_log_path != NULL && !input_recorder.open(input_log_path, chip8, seed)) {
+        return 1;
+    }
+    FrameStream stream;
+    if (stream_address != NULL && !stream.listen(stream_address)) {
+        return 1;
+    }
+    GdbStub gdb;
+    if (gdb_port != 0 && !gdb.listen(gdb_port)) {
+        return 1;
+    }
 
     // Chip-8 screen is 64x32
     Window window = Window(512);
     uint32_t pixels[NUM_PIXELS];
     fill(pixels, pixels + NUM_PIXELS, 0);
 
-    Chip8 chip8 = Chip8(debug);
-    chip8.init();
-    chip8.load_file(*(argv + 1));
-
-    // Emulation loop
+    // Emulation loop: one cycle per 1200us, with input polled and the
+    // screen presented once per frame of CYCLES_PER_FRAME cycles
+    auto frame_time = std::chrono::microseconds(1200 * CYCLES_PER_FRAME);
+    auto frame_start = std::chrono::steady_clock::now();
+    auto next_frame = frame_start + frame_time;
+    uint64_t frame = 0;
+    Metrics metrics;
+    char hud[256] = "";
+    // Exit cleanly on SIGINT/SIGTERM so the shared-memory segment is unlinked
+    signal(SIGINT, request_quit);
+    signal(SIGTERM, request_quit);
+    // A viewer or debugger hanging up shows as EPIPE from send(), not a signal
+    signal(SIGPIPE, SIG_IGN);
+    // With CHIP8_DEBUG set, SIGUSR1 saves the instruction trace
+    signal(SIGUSR1, request_trace);
+    int status = 0;
     while(true) {
-        chip8.emulate_cycle();
-        if (poll(&chip8) < 0) {
-            window.quit();
+        FrameSample sample = {};
+        SDL_PumpEvents();
+        sample.queued_events = SDL_PeepEvents(NULL, 0, SDL_PEEKEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT);
+        if (poll(&chip8) < 0 || quit_requested) {
             break;
         }
+        stream.poll(&chip8);
+        gdb.poll(chip8);
 
-        if(chip8.drawFlag) {
+        input_recorder.record_frame(chip8);
+        // Breakpoints are only checked while a debugger is attached
+        if (gdb.attached())
+            sample.instructions = gdb.run_frame(chip8);
+        else
+            sample.instructions = chip8.emulate_frame();
+        recorder.capture(chip8);
+        if (chip8.trapped && !gdb.attached()) {
+            fprintf(stderr, "Trapped: %s at 0x%03X (opcode 0x%04X)\n",
+                status_name(chip8.fault), chip8.fault_pc, chip8.fault_opcode);
+            status = 1;
+            break;
+        }
+        if (trace_requested && chip8.debug) {
+            if (chip8.trace->save(chip8, "chip8_trace.bin"))
+                fprintf(stderr, "Trace written to chip8_trace.bin\n");
+            trace_requested = 0;
+        }
+
+        // The HUD changes every frame, so present even without a draw
+        if(chip8.drawFlag || show_hud) {
             // Update pixels from chip8.gfx
-            for (int i = 0; i < 2048; i++) {
-                pixels[i] = (0x00FFFFFF * chip8.gfx[i]) | 0xFF000000;
-            }
-            window.draw_screen(pixels, NUM_PIXELS);
+            chip8.to_argb(pixels);
+            window.draw_screen(pixels, chip8.width(), chip8.height(), show_hud ? hud : NULL);
+            sample.present_us = window.last_draw_us();
+        }
+        if(chip8.drawFlag) {
+            stream.send_frame(chip8);
             chip8.drawFlag = false;
         }
-        std::this_thread::sleep_for(std::chrono::microseconds(1200));
+        frame_export.publish(chip8, ++frame);
+
+        std::this_thread::sleep_until(next_frame);
+        auto woke = std::chrono::steady_clock::now();
+        sample.overshoot_us = std::chrono::duration_cast<std::chrono::microseconds>(woke - next_frame).count();
+        sample.frame_us = std::chrono::duration_cast<std::chrono::microseconds>(woke - frame_start).count();
+        frame_start = woke;
+        next_frame += frame_time;
+
+        if (metrics.record(sample)) {
+            metrics.format_hud(hud, sizeof(hud));
+            if (metrics_path != NULL) {
+                metrics.write_prometheus(metrics_path);
+            }
+        }
     }
-    return 0;
+    window.quit();
+    input_recorder.close();
+
+    if (chip8.trapped && chip8.debug) {
+        if (chip8.trace->save(chip8, "chip8_trace.bin"))
+            fprintf(stderr, "Trace written to chip8_trace.bin\n");
+    }
+
+#ifdef CHIP8_PROFILE
+    if (chip8.profiler.dump(chip8.memory, chip8.memory.size(), "chip8_profile.txt", "chip8_profile.folded")) {
+        fprintf(stderr, "Profile written to chip8_profile.txt and chip8_profile.folded\n");
+    }
+#endif
+    return status;
 }
 
 int poll(Chip8* chip8) {
@@ -66,6 +255,9 @@ int poll(Chip8* chip8) {
             if (e.key.keysym.sym == SDLK_ESCAPE) {
                 return -1;
             }
+            if (e.key.keysym.sym == SDLK_F1) {
+                show_hud = !show_hud;
+            }
 
             for (int i = 0; i < 16; i++) {
                 if (e.key.keysym.sym == chip8->keymap[i]) {
@@ -87,7 +279,7 @@ int poll(Chip8* chip8) {
 
 int test(bool debug) {
     Tests tests = Tests(debug);
-    tests.run_tests();
-    printf("Tests complete!\n");
-    return 0;
+    int failures = tests.run_tests();
+    printf("Tests complete! %d failed\n", failures);
+    return failures > 0 ? 1 : 0;
 }
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+#include "metrics.hpp"
+
+Metrics::Metrics() {
+    memset(m_histogram, 0, sizeof(m_histogram));
+    m_elapsed_us = 0;
+    m_frames = 0;
+    m_instructions = 0;
+    m_frame_max_us = 0;
+    m_overshoot_sum_us = 0;
+    m_overshoot_max_us = 0;
+    m_present_sum_us = 0;
+    m_present_max_us = 0;
+    m_presents = 0;
+    m_queue_max = 0;
+}
+
+bool Metrics::record(const FrameSample& sample) {
+    int64_t bucket = sample.frame_us / METRICS_BUCKET_US;
+    m_histogram[bucket < METRICS_BUCKETS ? bucket : METRICS_BUCKETS - 1]++;
+    m_elapsed_us += sample.frame_us;
+    m_frames++;
+    m_instructions += sample.instructions;
+    if (sample.frame_us > m_frame_max_us)
+        m_frame_max_us = sample.frame_us;
+    m_overshoot_sum_us += sample.overshoot_us;
+    if (sample.overshoot_us > m_overshoot_max_us)
+        m_overshoot_max_us = sample.overshoot_us;
+    if (sample.present_us > 0) {
+        m_present_sum_us += sample.present_us;
+        m_presents++;
+        if (sample.present_us > m_present_max_us)
+            m_present_max_us = sample.present_us;
+    }
+    if (sample.queued_events > m_queue_max)
+        m_queue_max = sample.queued_events;
+
+    m_total_frames++;
+    m_total_instructions += sample.instructions;
+    m_total_frame_us += sample.frame_us;
+    m_total_overshoot_us += sample.overshoot_us;
+    if (sample.present_us > 0) {
+        m_total_present_us += sample.present_us;
+        m_total_presents++;
+    }
+
+    if (m_elapsed_us < METRICS_INTERVAL_US)
+        return false;
+
+    double seconds = m_elapsed_us / 1e6;
+    m_snapshot.ips = m_instructions / seconds;
+    m_snapshot.fps = m_frames / seconds;
+    // Bucket edges can overstate a quantile by up to one bucket; never past the max
+    m_snapshot.frame_max_ms = m_frame_max_us / 1e3;
+    m_snapshot.frame_p50_ms = std::min(quantile_ms(0.5), m_snapshot.frame_max_ms);
+    m_snapshot.frame_p99_ms = std::min(quantile_ms(0.99), m_snapshot.frame_max_ms);
+    m_snapshot.overshoot_avg_ms = m_overshoot_sum_us / 1e3 / m_frames;
+    m_snapshot.overshoot_max_ms = m_overshoot_max_us / 1e3;
+    m_snapshot.present_avg_ms = m_presents ? m_present_sum_us / 1e3 / m_presents : 0;
+    m_snapshot.present_max_ms = m_present_max_us / 1e3;
+    m_snapshot.queue_max = m_queue_max;
+
+    memset(m_histogram, 0, sizeof(m_histogram));
+    m_elapsed_us = 0;
+    m_frames = 0;
+    m_instructions = 0;
+    m_frame_max_us = 0;
+    m_overshoot_sum_us = 0;
+    m_overshoot_max_us = 0;
+    m_present_sum_us = 0;
+    m_present_max_us = 0;
+    m_presents = 0;
+    m_queue_max = 0;
+    return true;
+}
+
+double Metrics::quantile_ms(double q) const {
+    // Upper edge of the bucket holding the q-th sample
+    uint64_t rank = (uint64_t) (q * m_frames);
+    uint64_t seen = 0;
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        seen += m_histogram[i];
+        if (seen > rank)
+            return (i + 1) * METRICS_BUCKET_US / 1e3;
+    }
+    return METRICS_BUCKETS * METRICS_BUCKET_US / 1e3;
+}
+
+const MetricsSnapshot& Metrics::snapshot() const {
+    return m_snapshot;
+}
+
+void Metrics::format_hud(char* out, size_t size) const {
+    const MetricsSnapshot& s = m_snapshot;
+    snprintf(out, size,
+        "IPS %.0f FPS %.1f\n"
+        "FRAME P50 %.1f P99 %.1f MAX %.1f\n"
+        "OVERSHOOT %.2f MAX %.2f\n"
+        "PRESENT %.2f MAX %.2f\n"
+        "QUEUE %d",
+        s.ips, s.fps,
+        s.frame_p50_ms, s.frame_p99_ms, s.frame_max_ms,
+        s.overshoot_avg_ms, s.overshoot_max_ms,
+        s.present_avg_ms, s.present_max_ms,
+        s.queue_max);
+}
+
+bool Metrics::write_prometheus(const char* path) const {
+    // Write beside the target and rename, so scrapers never see a partial file
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* out = fopen(tmp_path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Failed to write metrics %s\n", tmp_path);
+        return false;
+    }
+
+    const MetricsSnapshot& s = m_snapshot;
+    fprintf(out, "# HELP chip8_instructions_total Instructions emulated.\n");
+    fprintf(out, "# TYPE chip8_instructions_total counter\n");
+    fprintf(out, "chip8_instructions_total %llu\n", (unsigned long long) m_total_instructions);
+    fprintf(out, "# HELP chip8_frames_total Frames emulated.\n");
+    fprintf(out, "# TYPE chip8_frames_total counter\n");
+    fprintf(out, "chip8_frames_total %llu\n", (unsigned long long) m_total_frames);
+    fprintf(out, "# HELP chip8_instructions_per_second Instructions per second over the last interval.\n");
+    fprintf(out, "# TYPE chip8_instructions_per_second gauge\n");
+    fprintf(out, "chip8_instructions_per_second %.1f\n", s.ips);
+    fprintf(out, "# HELP chip8_frames_per_second Frames per second over the last interval.\n");
+    fprintf(out, "# TYPE chip8_frames_per_second gauge\n");
+    fprintf(out, "chip8_frames_per_second %.2f\n", s.fps);
+    fprintf(out, "# HELP chip8_frame_seconds Frame time; quantiles cover the last interval.\n");
+    fprintf(out, "# TYPE chip8_frame_seconds summary\n");
+    fprintf(out, "chip8_frame_seconds{quantile=\"0.5\"} %.6f\n", s.frame_p50_ms / 1e3);
+    fprintf(out, "chip8_frame_seconds{quantile=\"0.99\"} %.6f\n", s.frame_p99_ms / 1e3);
+    fprintf(out, "chip8_frame_seconds_sum %.6f\n", m_total_frame_us / 1e6);
+    fprintf(out, "chip8_frame_seconds_count %llu\n", (unsigned long long) m_total_frames);
+    fprintf(out, "# HELP chip8_frame_max_seconds Slowest frame in the last interval.\n");
+    fprintf(out, "# TYPE chip8_frame_max_seconds gauge\n");
+    fprintf(out, "chip8_frame_max_seconds %.6f\n", s.frame_max_ms / 1e3);
+    fprintf(out, "# HELP chip8_sleep_overshoot_seconds_total Time the throttle slept past its deadline.\n");
+    fprintf(out, "# TYPE chip8_sleep_overshoot_seconds_total counter\n");
+    fprintf(out, "chip8_sleep_overshoot_seconds_total %.6f\n", m_total_overshoot_us / 1e6);
+    fprintf(out, "# HELP chip8_sleep_overshoot_max_seconds Worst overshoot in the last interval.\n");
+    fprintf(out, "# TYPE chip8_sleep_overshoot_max_seconds gauge\n");
+    fprintf(out, "chip8_sleep_overshoot_max_seconds %.6f\n", s.overshoot_max_ms / 1e3);
+    fprintf(out, "# HELP chip8_present_seconds Time spent drawing and presenting frames.\n");
+    fprintf(out, "# TYPE chip8_present_seconds summary\n");
+    fprintf(out, "chip8_present_seconds_sum %.6f\n", m_total_present_us / 1e6);
+    fprintf(out, "chip8_present_seconds_count %llu\n", (unsigned long long) m_total_presents);
+    fprintf(out, "# HELP chip8_present_max_seconds Slowest present in the last interval.\n");
+    fprintf(out, "# TYPE chip8_present_max_seconds gauge\n");
+    fprintf(out, "chip8_present_max_seconds %.6f\n", s.present_max_ms / 1e3);
+    fprintf(out, "# HELP chip8_input_queue_depth Most events waiting in the SDL queue in the last interval.\n");
+    fprintf(out, "# TYPE chip8_input_queue_depth gauge\n");
+    fprintf(out, "chip8_input_queue_depth %d\n", s.queue_max);
+
+    if (fclose(out) != 0 || rename(tmp_path, path) != 0) {
+        fprintf(stderr, "Failed to write metrics %s\n", path);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  Frame-loop metrics.
+
+  The main loop records one FrameSample per emulated frame. Every
+  METRICS_INTERVAL_US of wall time the samples are folded into a snapshot:
+  instructions and frames per second, frame-time p50/p99/max from a 0.1ms
+  histogram, how late the throttle's sleep woke up, how long presenting took,
+  and the deepest the SDL input queue got. Stutter from emulation, sleep
+  jitter and rendering shows up in different columns.
+*/
+
+#define METRICS_INTERVAL_US 1000000
+#define METRICS_BUCKET_US 100
+#define METRICS_BUCKETS 1000  // 0-100ms; the last bucket also takes anything slower
+
+struct FrameSample {
+    int instructions;
+    int64_t frame_us;      // wake-up to wake-up
+    int64_t overshoot_us;  // how far past its deadline sleep_until returned
+    int64_t present_us;    // 0 when nothing was drawn this frame
+    int queued_events;
+};
+
+struct MetricsSnapshot {
+    double ips = 0;
+    double fps = 0;
+    double frame_p50_ms = 0;
+    double frame_p99_ms = 0;
+    double frame_max_ms = 0;
+    double overshoot_avg_ms = 0;
+    double overshoot_max_ms = 0;
+    double present_avg_ms = 0;
+    double present_max_ms = 0;
+    int queue_max = 0;
+};
+
+class Metrics {
+public:
+    Metrics();
+    bool record(const FrameSample& sample);  // true when a new snapshot is ready
+    const MetricsSnapshot& snapshot() const;
+    void format_hud(char* out, size_t size) const;
+    bool write_prometheus(const char* path) const;
+
+private:
+    double quantile_ms(double q) const;
+
+    MetricsSnapshot m_snapshot;
+
+    // Current interval
+    uint32_t m_histogram[METRICS_BUCKETS];
+    int64_t m_elapsed_us;
+    uint64_t m_frames;
+    uint64_t m_instructions;
+    int64_t m_frame_max_us;
+    int64_t m_overshoot_sum_us;
+    int64_t m_overshoot_max_us;
+    int64_t m_present_sum_us;
+    int64_t m_present_max_us;
+    uint64_t m_presents;
+    int m_queue_max;
+
+    // Since startup
+    uint64_t m_total_frames = 0;
+    uint64_t m_total_instructions = 0;
+    int64_t m_total_frame_us = 0;
+    int64_t m_total_overshoot_us = 0;
+    int64_t m_total_present_us = 0;
+    uint64_t m_total_presents = 0;
+};
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <string.h>
+
+#include "oracle.hpp"
+
+bool ReferenceEngine::load(const RomImage& rom, const RomProfile& profile, uint64_t seed) {
+    vm.init();
+    vm.seed(seed);
+    if (!vm.load_rom(rom))
+        return false;
+    vm.set_profile(profile);
+    return true;
+}
+
+void ReferenceEngine::set_key(int key, bool pressed) {
+    vm.set_key(key, pressed);
+}
+
+void ReferenceEngine::step() {
+    vm.emulate_cycle();
+}
+
+bool ReferenceEngine::trapped() {
+    return vm.trapped;
+}
+
+void ReferenceEngine::state(VmState* out) {
+    out->pc = vm.pc;
+    out->I = vm.I;
+    out->sp = vm.sp;
+    memcpy(out->V, vm.V, 16);
+    memcpy(out->stack, vm.stack, sizeof(out->stack));
+    out->delay_timer = vm.delay_timer;
+    out->sound_timer = vm.sound_timer;
+    memcpy(out->rng, vm.rng, sizeof(out->rng));
+    out->trapped = vm.trapped;
+    out->fault = (uint8_t) vm.fault;
+    out->faults = vm.faults;
+    out->hires = vm.hires;
+    out->planes = vm.planes;
+    out->memory_size = vm.memory.size();
+    memcpy(out->memory, vm.memory, vm.memory.size());
+    memcpy(out->gfx, vm.gfx, vm.hires ? 128*64 : 64*32);
+}
+
+BatchEngine::BatchEngine() : vm(1) {
+}
+
+bool BatchEngine::load(const RomImage& rom, const RomProfile& profile, uint64_t seed) {
+    if (rom.variant() != Variant::Chip8 || profile.variant != Variant::Chip8)
+        return false;
+    vm.quirks = profile.quirks;
+    vm.init();
+    vm.seed(0, seed);
+    return vm.load(rom.data(), rom.size());
+}
+
+void BatchEngine::set_key(int key, bool pressed) {
+    vm.set_key(0, key, pressed);
+}
+
+void BatchEngine::step() {
+    vm.step();
+}
+
+bool BatchEngine::trapped() {
+    return vm.trapped[0];
+}
+
+void BatchEngine::state(VmState* out) {
+    out->pc = vm.pc[0];
+    out->I = vm.I[0];
+    out->sp = vm.sp[0];
+    for (int r = 0; r < 16; r++) {
+        out->V[r] = vm.V[r][0];
+    }
+    memcpy(out->stack, &vm.stack[0], sizeof(out->stack));
+    out->delay_timer = vm.delay_timer[0];
+    out->sound_timer = vm.sound_timer[0];
+    memcpy(out->rng, &vm.rng[0], sizeof(out->rng));
+    out->trapped = vm.trapped[0];
+    out->fault = vm.fault[0];
+    out->faults = vm.faults[0];
+    out->hires = false;
+    out->planes = 1;
+    out->memory_size = 4096;
+    for (int a = 0; a < 4096; a++) {
+        out->memory[a] = vm.mem(0, a);
+    }
+    memcpy(out->gfx, vm.lane_gfx(0), 64*32);
+}
+
+std::unique_ptr<Engine> make_engine(const char* name) {
+    if (!strcmp(name, "reference"))
+        return std::make_unique<ReferenceEngine>();
+    if (!strcmp(name, "batch"))
+        return std::make_unique<BatchEngine>();
+    return nullptr;
+}
+
+Oracle::Oracle(Engine& reference, Engine& candidate, uint64_t compare_every)
+    : m_reference(reference), m_candidate(candidate), m_compare_every(compare_every ? compare_every : 1) {
+}
+
+bool Oracle::load(const RomImage& rom, uint64_t seed, const RomProfile& profile) {
+    m_steps = 0;
+    m_report.clear();
+    m_unsupported = false;
+    Variant variant = std::max(rom.variant(), profile.variant);
+    for (Engine* engine : {&m_reference, &m_candidate}) {
+        if (!engine->supports(variant)) {
+            m_unsupported = true;
+            m_report = std::string(engine->name()) + " engine does not implement " + variant_name(variant);
+            return false;
+        }
+    }
+    bool loaded = m_reference.load(rom, profile, seed);
+    if (m_candidate.load(rom, profile, seed) != loaded) {
+        m_report = "engines disagree on whether the ROM loads";
+        return false;
+    }
+    return loaded && compare();
+}
+
+void Oracle::set_key(int key, bool pressed) {
+    m_reference.set_key(key, pressed);
+    m_candidate.set_key(key, pressed);
+}
+
+bool Oracle::run(uint64_t max_steps) {
+    for (uint64_t i = 0; i < max_steps && !m_reference.trapped(); i++) {
+        if (m_compare_every == 1) {
+            // The last comparison left the reference state at hand; note what is about to execute
+            m_last_pc = m_state[0].pc;
+            m_last_opcode = m_last_pc + 1u < m_state[0].memory_size
+                ? m_state[0].memory[m_last_pc] << 8 | m_state[0].memory[m_last_pc + 1] : 0;
+        }
+        m_reference.step();
+        m_candidate.step();
+        m_steps++;
+        if (m_steps % m_compare_every == 0 && !compare())
+            return false;
+    }
+    return m_steps % m_compare_every == 0 || compare();
+}
+
+static void diff_field(std::string& out, const char* name, unsigned a, unsigned b) {
+    if (a == b)
+        return;
+    char buf[96];
+    snprintf(buf, sizeof(buf), "  %s: 0x%X vs 0x%X\n", name, a, b);
+    out += buf;
+}
+
+bool Oracle::compare() {
+    VmState& a = m_state[0];
+    VmState& b = m_state[1];
+    m_reference.state(&a);
+    m_candidate.state(&b);
+    // Skip the stack slots above sp; they hold stale values neither engine reads
+    int pixels_size = a.hires ? 128*64 : 64*32;
+    if (a.pc == b.pc && a.I == b.I && a.sp == b.sp && !memcmp(a.V, b.V, 16)
+        && !memcmp(a.stack, b.stack, a.sp * sizeof(uint16_t))
+        && a.delay_timer == b.delay_timer && a.sound_timer == b.sound_timer
+        && !memcmp(a.rng, b.rng, sizeof(a.rng)) && a.trapped == b.trapped && a.fault == b.fault
+        && a.faults == b.faults && a.hires == b.hires && a.planes == b.planes
+        && a.memory_size == b.memory_size && !memcmp(a.memory, b.memory, a.memory_size)
+        && !memcmp(a.gfx, b.gfx, pixels_size))
+        return true;
+
+    char buf[160];
+    if (m_compare_every == 1) {
+        snprintf(buf, sizeof(buf), "%s and %s diverge after step %llu (pc 0x%03X, opcode 0x%04X)\n",
+            m_reference.name(), m_candidate.name(), (unsigned long long) m_steps, m_last_pc, m_last_opcode);
+    } else {
+        snprintf(buf, sizeof(buf), "%s and %s diverge within steps %llu-%llu\n",
+            m_reference.name(), m_candidate.name(),
+            (unsigned long long) (m_steps > m_compare_every ? m_steps - m_compare_every + 1 : 1),
+            (unsigned long long) m_steps);
+    }
+    m_report = buf;
+    diff_field(m_report, "pc", a.pc, b.pc);
+    diff_field(m_report, "I", a.I, b.I);
+    diff_field(m_report, "sp", a.sp, b.sp);
+    for (int r = 0; r < 16; r++) {
+        snprintf(buf, sizeof(buf), "V%X", r);
+        diff_field(m_report, buf, a.V[r], b.V[r]);
+    }
+    for (int s = 0; s < a.sp && s < 16; s++) {
+        snprintf(buf, sizeof(buf), "stack[%d]", s);
+        diff_field(m_report, buf, a.stack[s], b.stack[s]);
+    }
+    diff_field(m_report, "delay_timer", a.delay_timer, b.delay_timer);
+    diff_field(m_report, "sound_timer", a.sound_timer, b.sound_timer);
+    for (int r = 0; r < 4; r++) {
+        snprintf(buf, sizeof(buf), "rng[%d]", r);
+        diff_field(m_report, buf, a.rng[r], b.rng[r]);
+    }
+    diff_field(m_report, "trapped", a.trapped, b.trapped);
+    diff_field(m_report, "fault", a.fault, b.fault);
+    diff_field(m_report, "faults", a.faults, b.faults);
+    diff_field(m_report, "hires", a.hires, b.hires);
+    diff_field(m_report, "planes", a.planes, b.planes);
+    diff_field(m_report, "memory_size", a.memory_size, b.memory_size);
+
+    int shown = 0, differing = 0;
+    for (int addr = 0; addr < (int) std::min(a.memory_size, b.memory_size); addr++) {
+        if (a.memory[addr] == b.memory[addr])
+            continue;
+        if (shown < 8) {
+            snprintf(buf, sizeof(buf), "memory[0x%03X]", addr);
+            diff_field(m_report, buf, a.memory[addr], b.memory[addr]);
+            shown++;
+        }
+        differing++;
+    }
+    if (differing > shown) {
+        snprintf(buf, sizeof(buf), "  ... %d memory bytes differ in total\n", differing);
+        m_report += buf;
+    }
+    if (a.hires != b.hires)
+        return false;
+    int width = a.hires ? 128 : 64;
+    int first = -1, pixels = 0;
+    for (int i = 0; i < pixels_size; i++) {
+        if (a.gfx[i] != b.gfx[i]) {
+            if (first < 0)
+                first = i;
+            pixels++;
+        }
+    }
+    if (pixels > 0) {
+        snprintf(buf, sizeof(buf), "  gfx: %d pixels differ, first at (%d, %d)\n", pixels, first % width, first / width);
+        m_report += buf;
+    }
+    return false;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+#include "batch_vm.hpp"
+#include "chip8.hpp"
+
+/*
+  Lockstep differential oracle.
+
+  Runs the reference switch interpreter and a candidate engine side by side
+  on the same ROM, seed, keys and ROM profile (variant and quirks), and
+  compares their full observable state (registers, stack, timers, RNG, all
+  of memory, the framebuffer at its current resolution, sticky fault bits,
+  fault) after every instruction, or every compare_every instructions to go
+  faster. The first divergence stops the run with a report naming the
+  instruction that was executed and every field that differs.
+
+  A new engine is validated by wrapping it in an Engine adapter. An engine
+  that does not implement the ROM's variant says so through supports(); the
+  oracle then refuses the ROM (unsupported()) rather than report a
+  divergence. The batch engine is CHIP-8 only.
+*/
+
+struct VmState {
+    uint16_t pc;
+    uint16_t I;
+    uint8_t sp;
+    uint8_t V[16];
+    uint16_t stack[16];
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    uint32_t rng[4];
+    bool trapped;
+    uint8_t fault;
+    uint8_t faults;
+    bool hires;
+    uint8_t planes;
+    uint32_t memory_size;    // 4096, or 65536 for XO-CHIP
+    uint8_t memory[65536];   // first memory_size bytes
+    uint8_t gfx[128*64];     // first 64*32 bytes unless hires
+};
+
+class Engine {
+public:
+    virtual ~Engine() {}
+    virtual const char* name() const = 0;
+    virtual bool supports(Variant) const { return true; }
+    // The ROM with its detected variant, raised by the profile, and the profile's quirks
+    virtual bool load(const RomImage& rom, const RomProfile& profile, uint64_t seed) = 0;
+    virtual void set_key(int key, bool pressed) = 0;
+    virtual void step() = 0;  // exactly one instruction
+    virtual bool trapped() = 0;
+    virtual void state(VmState* out) = 0;
+};
+
+class ReferenceEngine : public Engine {
+public:
+    const char* name() const override { return "reference"; }
+    bool load(const RomImage& rom, const RomProfile& profile, uint64_t seed) override;
+    void set_key(int key, bool pressed) override;
+    void step() override;
+    bool trapped() override;
+    void state(VmState* out) override;
+
+    Chip8 vm;
+};
+
+// Lane 0 of a one-lane BatchChip8
+class BatchEngine : public Engine {
+public:
+    BatchEngine();
+    const char* name() const override { return "batch"; }
+    bool supports(Variant variant) const override { return variant == Variant::Chip8; }
+    bool load(const RomImage& rom, const RomProfile& profile, uint64_t seed) override;
+    void set_key(int key, bool pressed) override;
+    void step() override;
+    bool trapped() override;
+    void state(VmState* out) override;
+
+    BatchChip8 vm;
+};
+
+std::unique_ptr<Engine> make_engine(const char* name);
+
+class Oracle {
+public:
+    Oracle(Engine& reference, Engine& candidate, uint64_t compare_every = 1);
+    // false if the ROM does not load, the engines differ from the start, or
+    // an engine does not support the ROM's variant (see unsupported())
+    bool load(const RomImage& rom, uint64_t seed, const RomProfile& profile = RomProfile());
+    void set_key(int key, bool pressed);
+    // Runs up to max_steps instructions; false on divergence, see report()
+    bool run(uint64_t max_steps);
+    bool trapped() { return m_reference.trapped(); }
+    uint64_t steps() const { return m_steps; }
+    bool unsupported() const { return m_unsupported; }
+    const std::string& report() const { return m_report; }
+
+private:
+    bool compare();
+
+    Engine& m_reference;
+    Engine& m_candidate;
+    uint64_t m_compare_every;
+    uint64_t m_steps = 0;
+    bool m_unsupported = false;
+    uint16_t m_last_pc = 0;
+    uint16_t m_last_opcode = 0;
+    VmState m_state[2];
+    std::string m_report;
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <stddef.h>
+#include <thread>
+#include <vector>
+
+/*
+  Runs fn(i) for every i in [0, count) on up to `threads` threads. Workers
+  pull the next index from a shared counter, so long and short jobs balance
+  without any up-front partitioning. Returns once every call has finished.
+*/
+template <typename F>
+void parallel_for(size_t count, unsigned threads, F fn) {
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    threads = std::min<unsigned>(std::max(1u, threads), std::max<size_t>(1, count));
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&]() {
+            for (size_t i = next++; i < count; i = next++) {
+                fn(i);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <array>
+#include <stdio.h>
+#include <vector>
+
+#include "png.hpp"
+
+static uint32_t crc32(const uint8_t* data, size_t size) {
+    // Built once; static initialization is thread safe, and dumps are written from workers
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t;
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void put_be32(std::vector<uint8_t>& out, uint32_t v) {
+    out.push_back(v >> 24);
+    out.push_back(v >> 16);
+    out.push_back(v >> 8);
+    out.push_back(v);
+}
+
+static void write_chunk(FILE* out, const char* type, const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> chunk;
+    put_be32(chunk, (uint32_t) data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    // CRC covers the type and the data
+    put_be32(chunk, crc32(&chunk[4], chunk.size() - 4));
+    fwrite(chunk.data(), 1, chunk.size(), out);
+}
+
+bool write_png(const char* path, const uint8_t* rgb, int width, int height) {
+    FILE* out = fopen(path, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        return false;
+    }
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    fwrite(signature, 1, sizeof(signature), out);
+
+    std::vector<uint8_t> header;
+    put_be32(header, width);
+    put_be32(header, height);
+    header.push_back(8);  // bit depth
+    header.push_back(2);  // truecolor
+    header.push_back(0);  // deflate
+    header.push_back(0);  // adaptive filtering
+    header.push_back(0);  // no interlace
+    write_chunk(out, "IHDR", header);
+
+    // Scanlines, each preceded by filter type 0
+    std::vector<uint8_t> raw;
+    for (int y = 0; y < height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb + (size_t) y * width * 3, rgb + (size_t) (y + 1) * width * 3);
+    }
+
+    // zlib stream of stored blocks, at most 65535 bytes each
+    std::vector<uint8_t> z = {0x78, 0x01};
+    uint32_t a = 1, b = 0;
+    for (size_t pos = 0; pos < raw.size();) {
+        size_t len = std::min<size_t>(raw.size() - pos, 65535);
+        z.push_back(pos + len == raw.size() ? 1 : 0);
+        z.push_back(len & 0xFF);
+        z.push_back(len >> 8);
+        z.push_back(~len & 0xFF);
+        z.push_back((~len >> 8) & 0xFF);
+        for (size_t i = pos; i < pos + len; i++) {
+            z.push_back(raw[i]);
+            a = (a + raw[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        pos += len;
+    }
+    put_be32(z, b << 16 | a);
+    write_chunk(out, "IDAT", z);
+    write_chunk(out, "IEND", {});
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+  Minimal PNG writer for 8-bit RGB images. The image data is wrapped in
+  uncompressed (stored) deflate blocks, which keeps the writer dependency
+  free; the emulator's images are a few kilobytes either way.
+*/
+
+bool write_png(const char* path, const uint8_t* rgb, int width, int height);
@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <string>
+
+#include "chip8.hpp"
+#include "profiler.hpp"
+
+Profiler::Profiler() : m_pc(65536, 0) {
+    memset(m_family, 0, sizeof(m_family));
+    m_nodes.push_back(Node{0x200, -1, 0, {}});
+    m_node = 0;
+    m_draws = 0;
+    m_draw_gap_total_ms = 0;
+    m_draw_gap_max_ms = 0;
+}
+
+void Profiler::call(uint16_t addr) {
+    for (int child : m_nodes[m_node].children) {
+        if (m_nodes[child].addr == addr) {
+            m_node = child;
+            return;
+        }
+    }
+    m_nodes.push_back(Node{addr, m_node, 0, {}});
+    int child = m_nodes.size() - 1;
+    m_nodes[m_node].children.push_back(child);
+    m_node = child;
+}
+
+void Profiler::ret() {
+    // A return with nothing on the stack stays at the root
+    if (m_nodes[m_node].parent >= 0)
+        m_node = m_nodes[m_node].parent;
+}
+
+void Profiler::on_draw() {
+    auto now = std::chrono::steady_clock::now();
+    if (m_draws > 0) {
+        double gap = std::chrono::duration<double, std::milli>(now - m_last_draw).count();
+        m_draw_gap_total_ms += gap;
+        m_draw_gap_max_ms = std::max(m_draw_gap_max_ms, gap);
+    }
+    m_last_draw = now;
+    m_draws++;
+}
+
+void Profiler::write_folded(FILE* out, int node, std::string& stack) const {
+    const Node& n = m_nodes[node];
+    size_t len = stack.size();
+    char frame[16];
+    snprintf(frame, sizeof(frame), node == 0 ? "main" : "sub_%03X", n.addr);
+    if (!stack.empty())
+        stack += ';';
+    stack += frame;
+    if (n.samples > 0)
+        fprintf(out, "%s %llu\n", stack.c_str(), (unsigned long long) n.samples);
+    for (int child : n.children) {
+        write_folded(out, child, stack);
+    }
+    stack.resize(len);
+}
+
+bool Profiler::dump(const uint8_t* memory, size_t memory_size, const char* report_path, const char* folded_path) const {
+    FILE* out = fopen(report_path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Failed to write %s\n", report_path);
+        return false;
+    }
+    uint64_t total = 0;
+    for (int i = 0; i < NUM_OPS; i++) {
+        total += m_family[i];
+    }
+
+    std::vector<int> order(NUM_OPS);
+    for (int i = 0; i < NUM_OPS; i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return m_family[a] > m_family[b]; });
+    fprintf(out, "Instructions: %llu\n\nOpcode families:\n", (unsigned long long) total);
+    for (int f : order) {
+        if (m_family[f] == 0)
+            break;
+        fprintf(out, "  %-8s %14llu  %6.2f%%\n", op_pattern((Op) f), (unsigned long long) m_family[f],
+                100.0 * m_family[f] / total);
+    }
+
+    std::vector<int> pcs(m_pc.size());
+    for (size_t i = 0; i < pcs.size(); i++) {
+        pcs[i] = i;
+    }
+    std::partial_sort(pcs.begin(), pcs.begin() + 32, pcs.end(), [&](int a, int b) { return m_pc[a] > m_pc[b]; });
+    fprintf(out, "\nHot addresses:\n");
+    const size_t mask = memory_size - 1;
+    for (int i = 0; i < 32 && m_pc[pcs[i]] > 0; i++) {
+        int pc = pcs[i];
+        uint16_t opcode = memory[pc & mask] << 8 | memory[(pc + 1) & mask];
+        char text[32];
+        format_instruction(opcode, text, sizeof(text));
+        fprintf(out, "  0x%03X  %04X  %-16s %14llu  %6.2f%%\n", pc, opcode, text,
+                (unsigned long long) m_pc[pc], 100.0 * m_pc[pc] / total);
+    }
+
+    fprintf(out, "\nDraws: %llu", (unsigned long long) m_draws);
+    if (m_draws > 1) {
+        fprintf(out, ", mean %.3f ms apart, max %.3f ms", m_draw_gap_total_ms / (m_draws - 1), m_draw_gap_max_ms);
+    }
+    fprintf(out, "\n");
+    fclose(out);
+
+    out = fopen(folded_path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Failed to write %s\n", folded_path);
+        return false;
+    }
+    std::string stack;
+    write_folded(out, 0, stack);
+    fclose(out);
+    return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "decode.hpp"
+
+/*
+  Per-opcode and hot-pc profiler.
+
+  Only compiled into emulate_cycle when the build defines CHIP8_PROFILE
+  (cmake -DCHIP8_PROFILE=ON); the normal build has no counters at all.
+  Counts executions per opcode family and per pc (all 64KB of it, so XO-CHIP
+  code above 4KB gets its own hot spots), tracks the 2NNN/00EE call
+  stack for a flamegraph-compatible folded-stack dump, and times the interval
+  between draws.
+*/
+
+class Profiler {
+public:
+    Profiler();
+    void on_cycle(uint16_t pc, uint16_t opcode) {
+        m_family[(int) decode(opcode)]++;
+        m_pc[pc]++;
+        m_nodes[m_node].samples++;
+
+        if ((opcode & 0xF000) == 0x2000)
+            call(opcode & 0x0FFF);
+        else if (opcode == 0x00EE)
+            ret();
+        else if ((opcode & 0xF000) == 0xD000 || opcode == 0x00E0)
+            on_draw();
+    }
+    bool dump(const uint8_t* memory, size_t memory_size, const char* report_path, const char* folded_path) const;
+
+private:
+    struct Node {
+        uint16_t addr;       // subroutine entry; 0x200 for the root
+        int parent;
+        uint64_t samples;    // instructions executed directly in this frame
+        std::vector<int> children;
+    };
+
+    void call(uint16_t addr);
+    void ret();
+    void on_draw();
+    void write_folded(FILE* out, int node, std::string& stack) const;
+
+    uint64_t m_family[NUM_OPS];
+    std::vector<uint64_t> m_pc;  // indexed by the full 16-bit pc
+    std::vector<Node> m_nodes;
+    int m_node;
+
+    std::chrono::steady_clock::time_point m_last_draw;
+    uint64_t m_draws;
+    double m_draw_gap_total_ms;
+    double m_draw_gap_max_ms;
+};
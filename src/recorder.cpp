@@ -0,0 +1,91 @@
+#include "recorder.hpp"
+
+// Video-range luma for off and on pixels
+#define LUMA_BLACK 16
+#define LUMA_WHITE 235
+
+Recorder::~Recorder() {
+    close();
+}
+
+bool Recorder::open(const char* path, int scale) {
+    m_file = fopen(path, "wb");
+    if (m_file == NULL) {
+        fprintf(stderr, "Failed to open %s for recording\n", path);
+        return false;
+    }
+    m_scale = scale < 1 ? 1 : scale;
+    int width = 64 * m_scale;
+    int height = 32 * m_scale;
+    fprintf(m_file, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg\n", width, height);
+
+    m_luma.resize(width * height);
+    m_chroma.assign(2 * (width / 2) * (height / 2), 128);
+    m_stop = false;
+    m_thread = std::thread(&Recorder::writer_loop, this);
+    return true;
+}
+
+void Recorder::capture(const Chip8& vm) {
+    if (m_file == NULL)
+        return;
+    uint64_t head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) >= RECORDER_RING_SIZE) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    vm.copy_lores(m_ring[head % RECORDER_RING_SIZE]);
+    m_head.store(head + 1, std::memory_order_release);
+    m_cv.notify_one();
+}
+
+void Recorder::writer_loop() {
+    long reported = 0;
+    while (true) {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) {
+            if (m_stop)
+                break;
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait_for(lock, std::chrono::milliseconds(10));
+            continue;
+        }
+
+        write_frame(m_ring[tail % RECORDER_RING_SIZE]);
+        m_tail.store(tail + 1, std::memory_order_release);
+
+        long dropped = m_dropped.load(std::memory_order_relaxed);
+        if (dropped != reported) {
+            fprintf(stderr, "Recording fell behind: %ld frames dropped\n", dropped);
+            reported = dropped;
+        }
+    }
+}
+
+void Recorder::write_frame(const uint8_t* gfx) {
+    int width = 64 * m_scale;
+    for (int y = 0; y < 32; y++) {
+        uint8_t* row = &m_luma[y * m_scale * width];
+        for (int x = 0; x < 64; x++) {
+            memset(row + x * m_scale, gfx[y * 64 + x] ? LUMA_WHITE : LUMA_BLACK, m_scale);
+        }
+        for (int i = 1; i < m_scale; i++) {
+            memcpy(row + i * width, row, width);
+        }
+    }
+    fputs("FRAME\n", m_file);
+    fwrite(m_luma.data(), 1, m_luma.size(), m_file);
+    fwrite(m_chroma.data(), 1, m_chroma.size(), m_file);
+    m_written++;
+}
+
+void Recorder::close() {
+    if (m_file == NULL)
+        return;
+    m_stop = true;
+    m_cv.notify_one();
+    m_thread.join();
+    fclose(m_file);
+    m_file = NULL;
+    fprintf(stderr, "Recorded %ld frames, %ld dropped\n", m_written, m_dropped.load());
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "chip8.hpp"
+
+/*
+  Video capture to a Y4M file.
+
+  capture() copies the framebuffer into a bounded single-producer ring and
+  returns; scaling, encoding and disk writes happen on a background writer
+  thread, so recording never stalls the emulation loop. If the ring is full
+  because the disk fell behind, the frame is dropped and counted.
+*/
+
+#define RECORDER_RING_SIZE 128
+
+class Recorder {
+public:
+    ~Recorder();
+    bool open(const char* path, int scale);
+    void capture(const Chip8& vm);
+    void close();
+
+private:
+    void writer_loop();
+    void write_frame(const uint8_t* gfx);
+
+    FILE* m_file = NULL;
+    int m_scale = 1;
+    std::thread m_thread;
+    std::atomic<bool> m_stop{false};
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+
+    uint8_t m_ring[RECORDER_RING_SIZE][64*32];
+    std::atomic<uint64_t> m_head{0};    // next slot the emulator writes
+    std::atomic<uint64_t> m_tail{0};    // next slot the writer reads
+    std::atomic<long> m_dropped{0};
+    long m_written = 0;
+
+    std::vector<uint8_t> m_luma;        // writer-owned scaled frame
+    std::vector<uint8_t> m_chroma;      // constant neutral chroma planes
+};
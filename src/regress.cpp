@@ -0,0 +1,333 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "parallel.hpp"
+#include "png.hpp"
+#include "regress.hpp"
+
+#define DUMP_WIDTH 256  // a dump panel is this wide whatever the resolution
+#define DUMP_GAP 8
+
+// The framebuffer at native resolution, one byte per pixel with the plane bits
+struct RegressFrame {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+struct RegressResult {
+    bool passed = true;
+    std::string message;
+    double wall_ms = 0;
+    std::vector<uint64_t> hashes;      // per check
+    std::vector<RegressFrame> frames;  // per check
+};
+
+bool load_manifest(const char* path, std::vector<RegressCase>& cases, std::vector<std::string>& lines) {
+    std::ifstream in(path);
+    if (!in) {
+        fprintf(stderr, "Failed to open manifest %s\n", path);
+        return false;
+    }
+    std::filesystem::path dir = std::filesystem::path(path).parent_path();
+
+    std::string line;
+    while (std::getline(in, line)) {
+        lines.push_back(line);
+        std::string text = line.substr(0, line.find('#'));
+        char directive[16], arg[1024];
+        unsigned long long a, b, c;
+        if (sscanf(text.c_str(), "%15s", directive) != 1)
+            continue;
+
+        bool ok = true;
+        if (!strcmp(directive, "case") && sscanf(text.c_str(), "%*s %1023s", arg) == 1) {
+            cases.emplace_back();
+            cases.back().name = arg;
+        } else if (cases.empty()) {
+            ok = false;
+        } else if (!strcmp(directive, "rom") && sscanf(text.c_str(), "%*s %1023s", arg) == 1) {
+            cases.back().rom = (dir / arg).string();
+        } else if (!strcmp(directive, "input") && sscanf(text.c_str(), "%*s %1023s", arg) == 1) {
+            cases.back().input = (dir / arg).string();
+        } else if (!strcmp(directive, "seed") && sscanf(text.c_str(), "%*s %llu", &a) == 1) {
+            cases.back().seed = a;
+        } else if (!strcmp(directive, "frames") && sscanf(text.c_str(), "%*s %llu", &a) == 1) {
+            cases.back().frames = a;
+        } else if (!strcmp(directive, "key") && sscanf(text.c_str(), "%*s %llu %llu %llu", &a, &b, &c) == 3 && b < 16) {
+            cases.back().events.push_back({a, (uint8_t) b, c != 0});
+        } else if (!strcmp(directive, "check") && sscanf(text.c_str(), "%*s %llu", &a) == 1) {
+            // A missing hash is filled in by --update
+            if (sscanf(text.c_str(), "%*s %*u %llx", &b) != 1)
+                b = 0;
+            cases.back().checks.push_back({a, b, lines.size() - 1});
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            fprintf(stderr, "%s:%zu: cannot parse '%s'\n", path, lines.size(), line.c_str());
+            return false;
+        }
+    }
+
+    for (auto& c : cases) {
+        if (c.rom.empty() || c.checks.empty()) {
+            fprintf(stderr, "%s: case %s needs a rom and at least one check\n", path, c.name.c_str());
+            return false;
+        }
+        std::stable_sort(c.events.begin(), c.events.end(),
+            [](const InputEvent& x, const InputEvent& y) { return x.frame < y.frame; });
+        std::sort(c.checks.begin(), c.checks.end(),
+            [](const RegressCheck& x, const RegressCheck& y) { return x.frame < y.frame; });
+        if (c.frames == 0)
+            c.frames = c.checks.back().frame + 1;
+        if (c.checks.back().frame >= c.frames) {
+            fprintf(stderr, "%s:%zu: case %s checks frame %llu but only runs %llu frames\n", path,
+                c.checks.back().line + 1, c.name.c_str(), (unsigned long long) c.checks.back().frame,
+                (unsigned long long) c.frames);
+            return false;
+        }
+    }
+    return true;
+}
+
+static RegressResult run_case(const RegressCase& c, const RomDb* db) {
+    RegressResult result;
+    Chip8 vm;
+    vm.init();
+    if (!vm.load_file(c.rom.c_str())) {
+        result.passed = false;
+        result.message = "cannot load " + c.rom;
+        return result;
+    }
+    if (db != NULL)
+        configure_rom(vm, *db);
+
+    uint64_t seed = c.seed;
+    std::vector<InputEvent> events = c.events;
+    if (!c.input.empty()) {
+        InputLog log;
+        if (!log.load(c.input.c_str())) {
+            result.passed = false;
+            result.message = "cannot load " + c.input;
+            return result;
+        }
+        seed = log.seed;
+        events.insert(events.end(), log.events.begin(), log.events.end());
+        std::stable_sort(events.begin(), events.end(),
+            [](const InputEvent& x, const InputEvent& y) { return x.frame < y.frame; });
+    }
+    vm.seed(seed);
+
+    auto start = std::chrono::steady_clock::now();
+    size_t next_event = 0, next_check = 0;
+    for (uint64_t frame = 0; frame < c.frames && next_check < c.checks.size(); frame++) {
+        while (next_event < events.size() && events[next_event].frame <= frame) {
+            vm.set_key(events[next_event].key, events[next_event].pressed);
+            next_event++;
+        }
+        vm.emulate_frame();
+        if (vm.trapped) {
+            char buf[128];
+            snprintf(buf, sizeof(buf), "trapped at frame %llu: %s at 0x%03X",
+                (unsigned long long) frame, status_name(vm.fault), vm.fault_pc);
+            result.passed = false;
+            result.message = buf;
+            break;
+        }
+        while (next_check < c.checks.size() && c.checks[next_check].frame == frame) {
+            result.hashes.push_back(vm.gfx_hash());
+            RegressFrame& out = result.frames.emplace_back();
+            out.width = vm.width();
+            out.height = vm.height();
+            const uint8_t* pixels = vm.gfx;
+            out.pixels.assign(pixels, pixels + out.width * out.height);
+            next_check++;
+        }
+    }
+    // Every check has to be evaluated, or the case proves nothing
+    if (result.passed && next_check < c.checks.size()) {
+        result.passed = false;
+        result.message = "check at frame " + std::to_string(c.checks[next_check].frame) + " was never reached";
+    }
+    result.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+static std::string golden_path(const std::filesystem::path& dir, const RegressCase& c, uint64_t frame) {
+    return (dir / "golden" / (c.name + "_" + std::to_string(frame) + ".pgm")).string();
+}
+
+static bool read_pgm(const std::string& path, RegressFrame& frame) {
+    // Binary PGM at native resolution, maxval 3: each byte is a gfx pixel
+    FILE* in = fopen(path.c_str(), "rb");
+    if (in == NULL)
+        return false;
+    int w, h, maxval;
+    bool ok = fscanf(in, "P5 %d %d %d", &w, &h, &maxval) == 3 && (w == 64 || w == 128) && h == w / 2
+        && maxval == 3 && fgetc(in) != EOF;
+    if (ok) {
+        frame.width = w;
+        frame.height = h;
+        frame.pixels.resize(w * h);
+        ok = fread(frame.pixels.data(), 1, w * h, in) == (size_t) (w * h);
+    }
+    fclose(in);
+    return ok;
+}
+
+static bool write_pgm(const std::string& path, const RegressFrame& frame) {
+    FILE* out = fopen(path.c_str(), "wb");
+    if (out == NULL) {
+        fprintf(stderr, "Failed to write %s\n", path.c_str());
+        return false;
+    }
+    fprintf(out, "P5\n%d %d\n3\n", frame.width, frame.height);
+    fwrite(frame.pixels.data(), 1, frame.pixels.size(), out);
+    return fclose(out) == 0;
+}
+
+static void write_dump(const std::string& path, const RegressFrame* expected, const RegressFrame& actual) {
+    // Expected | actual | difference, scaled up; a missing golden frame, or
+    // one at another resolution, shows as grey
+    if (expected != NULL && expected->width != actual.width)
+        expected = NULL;
+    const int scale = DUMP_WIDTH / actual.width;
+    const int panel = DUMP_WIDTH;
+    const int width = 3 * panel + 2 * DUMP_GAP;
+    const int height = actual.height * scale;
+    // Plane 1 white, plane 2 light grey, both dark grey
+    const uint8_t levels[4] = {0x00, 0xFF, 0xAA, 0x55};
+    std::vector<uint8_t> rgb((size_t) width * height * 3, 0x40);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < panel; x++) {
+            int i = (y / scale) * actual.width + x / scale;
+            uint8_t a = actual.pixels[i] & 3;
+            uint8_t e = expected != NULL ? expected->pixels[i] & 3 : 0;
+            uint8_t colors[3][3] = {
+                {0x80, 0x80, 0x80},
+                {0, 0, 0},
+                {0, 0, 0},
+            };
+            if (expected != NULL) {
+                memset(colors[0], levels[e], 3);
+            }
+            memset(colors[1], levels[a], 3);
+            if (a != e) {
+                // Red: a plane lit only in actual, blue: only in expected
+                colors[2][0] = (a & ~e) ? 0xFF : 0x00;
+                colors[2][2] = (e & ~a) ? 0xFF : 0x00;
+            } else if (a) {
+                memset(colors[2], 0x50, 3);
+            }
+            for (int p = 0; p < 3; p++) {
+                uint8_t* px = &rgb[((size_t) y * width + p * (panel + DUMP_GAP) + x) * 3];
+                memcpy(px, colors[p], 3);
+            }
+        }
+    }
+    write_png(path.c_str(), rgb.data(), width, height);
+}
+
+int regress(int argc, char** argv) {
+    const char* manifest = NULL;
+    const char* dump_dir = "regress_dumps";
+    const char* romdb = NULL;
+    bool update = false;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 0; i < argc; i++) {
+        if (!strcmp(argv[i], "--update")) {
+            update = true;
+        } else if (!strcmp(argv[i], "--dump") && i + 1 < argc) {
+            dump_dir = argv[++i];
+        } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            threads = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--romdb") && i + 1 < argc) {
+            romdb = argv[++i];
+        } else {
+            manifest = argv[i];
+        }
+    }
+    if (manifest == NULL) {
+        fprintf(stderr, "Usage: ./chip8 regress [--update] [-j THREADS] [--dump DIR] [--romdb PATH] <manifest>\n");
+        return 1;
+    }
+    RomDb db;
+    const char* db_path = romdb_path(romdb);
+    if (db_path != NULL && !db.load(db_path)) {
+        return 1;
+    }
+
+    std::vector<RegressCase> cases;
+    std::vector<std::string> lines;
+    if (!load_manifest(manifest, cases, lines)) {
+        return 1;
+    }
+    std::filesystem::path dir = std::filesystem::path(manifest).parent_path();
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<RegressResult> results(cases.size());
+    parallel_for(cases.size(), threads, [&](size_t i) {
+        results[i] = run_case(cases[i], db_path != NULL ? &db : NULL);
+    });
+    double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    int failures = 0;
+    for (size_t i = 0; i < cases.size(); i++) {
+        const RegressCase& c = cases[i];
+        RegressResult& r = results[i];
+
+        if (update && r.passed) {
+            std::filesystem::create_directories(dir / "golden");
+            for (size_t k = 0; k < r.hashes.size(); k++) {
+                char hash[32];
+                snprintf(hash, sizeof(hash), "%016llx", (unsigned long long) r.hashes[k]);
+                lines[c.checks[k].line] = "check " + std::to_string(c.checks[k].frame) + " " + hash;
+                write_pgm(golden_path(dir, c, c.checks[k].frame), r.frames[k]);
+            }
+            printf("UPDATED %s (%zu checks)\n", c.name.c_str(), r.hashes.size());
+            continue;
+        }
+
+        for (size_t k = 0; k < r.hashes.size() && r.passed; k++) {
+            if (r.hashes[k] == c.checks[k].hash)
+                continue;
+            std::filesystem::create_directories(dump_dir);
+            std::string dump = (std::filesystem::path(dump_dir) / (c.name + "_" + std::to_string(c.checks[k].frame) + ".png")).string();
+            RegressFrame expected;
+            bool have_golden = read_pgm(golden_path(dir, c, c.checks[k].frame), expected);
+            write_dump(dump, have_golden ? &expected : NULL, r.frames[k]);
+
+            char buf[256];
+            snprintf(buf, sizeof(buf), "frame %llu: expected %016llx, got %016llx (see %s)",
+                (unsigned long long) c.checks[k].frame, (unsigned long long) c.checks[k].hash,
+                (unsigned long long) r.hashes[k], dump.c_str());
+            r.passed = false;
+            r.message = buf;
+        }
+
+        if (r.passed) {
+            printf("PASS %s (%llu frames, %zu checks, %.1f ms)\n", c.name.c_str(),
+                (unsigned long long) c.frames, c.checks.size(), r.wall_ms);
+        } else {
+            printf("FAIL %s: %s\n", c.name.c_str(), r.message.c_str());
+            failures++;
+        }
+    }
+
+    if (update) {
+        std::ofstream out(manifest);
+        for (const auto& line : lines) {
+            out << line << "\n";
+        }
+        if (!out) {
+            fprintf(stderr, "Failed to rewrite %s\n", manifest);
+            return 1;
+        }
+    }
+    printf("%zu cases, %d failed, %.1f ms\n", cases.size(), failures, wall_ms);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "replay.hpp"
+
+/*
+  Golden-frame regression suite.
+
+  A manifest lists cases, each a ROM run headless for a fixed number of
+  frames with scripted key input, and the framebuffer hash expected after
+  chosen frames. Cases run in parallel. On a mismatch a PNG with the expected
+  frame, the actual frame and their difference side by side is written to the
+  dump directory; expected frames come from golden/<case>_<frame>.pgm next to
+  the manifest, stored at the ROM's resolution with one byte of plane bits
+  per pixel. --update rewrites the hashes in place and refreshes the golden
+  frames.
+
+  Manifest syntax, one directive per line, '#' starts a comment:
+    case <name>                 starts a case
+    rom <path>                  relative to the manifest
+    input <path>                optional input log from --record-input; supplies seed and keys
+    seed <n>                    CXNN seed, default 0
+    frames <n>                  frames to run, default last checkpoint + 1
+    key <frame> <key> <0|1>     key state applied before that frame runs
+    check <frame> <hash>        gfx_hash after that frame, frames count from 0 as in replay --hashes
+
+  ROMs run with the variant they need and, with --romdb or CHIP8_ROMDB, their
+  database profile.
+
+  Usage: ./chip8 regress [--update] [-j THREADS] [--dump DIR] [--romdb PATH] <manifest>
+*/
+
+struct RegressCheck {
+    uint64_t frame;
+    uint64_t hash;
+    size_t line;  // manifest line, for --update
+};
+
+struct RegressCase {
+    std::string name;
+    std::string rom;
+    std::string input;
+    uint64_t seed = 0;
+    uint64_t frames = 0;
+    std::vector<InputEvent> events;
+    std::vector<RegressCheck> checks;
+};
+
+bool load_manifest(const char* path, std::vector<RegressCase>& cases, std::vector<std::string>& lines);
+int regress(int argc, char** argv);
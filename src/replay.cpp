@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+
+#include "replay.hpp"
+
+uint64_t rom_hash(const Chip8& vm) {
+    // init() zeroes memory, so this depends only on the ROM; same hash as RomImage::hash()
+    return program_hash(vm.memory, vm.memory.size());
+}
+
+InputRecorder::~InputRecorder() {
+    close();
+}
+
+bool InputRecorder::open(const char* path, const Chip8& vm, uint64_t seed) {
+    m_file = fopen(path, "wb");
+    if (m_file == NULL) {
+        fprintf(stderr, "Failed to open input log %s\n", path);
+        return false;
+    }
+    uint32_t header[2] = {INPUT_LOG_MAGIC, INPUT_LOG_VERSION};
+    uint64_t hash = rom_hash(vm);
+    fwrite(header, sizeof(header), 1, m_file);
+    fwrite(&seed, sizeof(seed), 1, m_file);
+    fwrite(&hash, sizeof(hash), 1, m_file);
+    memcpy(m_keys, vm.key, 16);
+    m_frame = 0;
+    m_last_event = 0;
+    return true;
+}
+
+void InputRecorder::write_varint(uint64_t value) {
+    while (value >= 0x80) {
+        fputc((int) (value & 0x7F) | 0x80, m_file);
+        value >>= 7;
+    }
+    fputc((int) value, m_file);
+}
+
+void InputRecorder::record_frame(const Chip8& vm) {
+    if (m_file == NULL)
+        return;
+    for (int i = 0; i < 16; i++) {
+        if (vm.key[i] == m_keys[i])
+            continue;
+        write_varint(m_frame - m_last_event);
+        fputc(i | (vm.key[i] ? 0x10 : 0), m_file);
+        m_keys[i] = vm.key[i];
+        m_last_event = m_frame;
+    }
+    m_frame++;
+}
+
+void InputRecorder::close() {
+    if (m_file == NULL)
+        return;
+    write_varint(m_frame - m_last_event);
+    fputc(INPUT_LOG_END, m_file);
+    fclose(m_file);
+    m_file = NULL;
+}
+
+bool InputLog::load(const char* path) {
+    FILE* in = fopen(path, "rb");
+    if (in == NULL) {
+        fprintf(stderr, "Failed to open input log %s\n", path);
+        return false;
+    }
+    uint32_t header[2];
+    if (fread(header, sizeof(header), 1, in) != 1 || header[0] != INPUT_LOG_MAGIC || header[1] != INPUT_LOG_VERSION
+        || fread(&seed, sizeof(seed), 1, in) != 1 || fread(&rom_hash, sizeof(rom_hash), 1, in) != 1) {
+        fprintf(stderr, "%s is not a chip8 input log\n", path);
+        fclose(in);
+        return false;
+    }
+
+    events.clear();
+    uint64_t frame = 0;
+    while (true) {
+        uint64_t delta = 0;
+        int shift = 0, c;
+        while ((c = fgetc(in)) != EOF) {
+            delta |= (uint64_t) (c & 0x7F) << shift;
+            shift += 7;
+            if (!(c & 0x80))
+                break;
+        }
+        int code = fgetc(in);
+        if (c == EOF || code == EOF) {
+            // Truncated, e.g. the session was killed; keep what was recorded
+            fprintf(stderr, "%s: log ends without an end marker\n", path);
+            frames = frame;
+            break;
+        }
+        frame += delta;
+        if (code == INPUT_LOG_END) {
+            frames = frame;
+            break;
+        }
+        events.push_back({frame, (uint8_t) (code & 0xF), (code & 0x10) != 0});
+    }
+    fclose(in);
+    return true;
+}
+
+static bool load_expected(const char* path, std::map<uint64_t, uint64_t>& out) {
+    FILE* in = fopen(path, "r");
+    if (in == NULL) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return false;
+    }
+    unsigned long long frame, hash;
+    while (fscanf(in, "%llu %llx", &frame, &hash) == 2) {
+        out[frame] = hash;
+    }
+    fclose(in);
+    return true;
+}
+
+int replay(int argc, char** argv) {
+    const char* rom_path = NULL;
+    const char* log_path = NULL;
+    const char* expect_path = NULL;
+    const char* romdb = NULL;
+    bool print_hashes = false;
+    bool strict = false;
+    long long until = -1;
+    for (int i = 0; i < argc; i++) {
+        if (!strcmp(argv[i], "--hashes")) {
+            print_hashes = true;
+        } else if (!strcmp(argv[i], "--until") && i + 1 < argc) {
+            until = atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--expect") && i + 1 < argc) {
+            expect_path = argv[++i];
+        } else if (!strcmp(argv[i], "--romdb") && i + 1 < argc) {
+            romdb = argv[++i];
+        } else if (!strcmp(argv[i], "--strict")) {
+            strict = true;
+        } else if (rom_path == NULL) {
+            rom_path = argv[i];
+        } else {
+            log_path = argv[i];
+        }
+    }
+    if (rom_path == NULL || log_path == NULL) {
+        fprintf(stderr, "Usage: ./chip8 replay [--hashes] [--until FRAME] [--expect HASHES] [--romdb PATH] [--strict] <ROM> <input log>\n");
+        return 1;
+    }
+
+    InputLog log;
+    if (!log.load(log_path)) {
+        return 1;
+    }
+    std::map<uint64_t, uint64_t> expected;
+    if (expect_path != NULL && !load_expected(expect_path, expected)) {
+        return 1;
+    }
+
+    Chip8 vm;
+    vm.init();
+    if (!vm.load_file(rom_path)) {
+        return 1;
+    }
+    if (rom_hash(vm) != log.rom_hash) {
+        fprintf(stderr, "Warning: %s is not the ROM this log was recorded with\n", rom_path);
+    }
+    if (!configure_rom(vm, romdb)) {
+        return 1;
+    }
+    vm.seed(log.seed);
+    if (strict)
+        vm.fatal_faults = FAULT_READ_WRAP | FAULT_WRITE_WRAP;
+
+    // Frames run flat out with no throttle; hashes are taken after each frame
+    uint64_t frames = until >= 0 && (uint64_t) until < log.frames ? (uint64_t) until : log.frames;
+    size_t next_event = 0;
+    uint64_t frame = 0;
+    for (; frame < frames && !vm.trapped; frame++) {
+        while (next_event < log.events.size() && log.events[next_event].frame == frame) {
+            vm.set_key(log.events[next_event].key, log.events[next_event].pressed);
+            next_event++;
+        }
+        vm.emulate_frame();
+
+        uint64_t hash = vm.gfx_hash();
+        if (print_hashes) {
+            printf("%llu %016llx\n", (unsigned long long) frame, (unsigned long long) hash);
+        }
+        auto it = expected.find(frame);
+        if (it != expected.end() && it->second != hash) {
+            printf("Mismatch at frame %llu: expected %016llx, got %016llx\n",
+                (unsigned long long) frame, (unsigned long long) it->second, (unsigned long long) hash);
+            return 1;
+        }
+    }
+
+    printf("%llu frames, final hash %016llx", (unsigned long long) frame, (unsigned long long) vm.gfx_hash());
+    if (vm.trapped)
+        printf(", trapped: %s at 0x%03X", status_name(vm.fault), vm.fault_pc);
+    printf("\n");
+    return vm.trapped ? 1 : 0;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "chip8.hpp"
+
+/*
+  Deterministic input recording and replay.
+
+  A session is fully described by its ROM, the seed the VM started from and
+  the key state at the start of every frame. The log stores the seed and a
+  hash of the loaded ROM, then one entry per key change: a varint frame delta
+  followed by a byte holding the key index and, in bit 4, pressed/released.
+  An end marker (delta, 0xFF) records how many frames the session ran.
+
+  Key state is sampled once per frame, which is all the VM can observe, so a
+  replay sees exactly the inputs the live session did.
+*/
+
+#define INPUT_LOG_MAGIC 0x4E493843  // "C8IN"
+#define INPUT_LOG_VERSION 1
+#define INPUT_LOG_END 0xFF
+
+struct InputEvent {
+    uint64_t frame;
+    uint8_t key;
+    bool pressed;
+};
+
+struct InputLog {
+    uint64_t seed = 0;
+    uint64_t rom_hash = 0;
+    uint64_t frames = 0;
+    std::vector<InputEvent> events;
+
+    bool load(const char* path);
+};
+
+class InputRecorder {
+public:
+    ~InputRecorder();
+    bool open(const char* path, const Chip8& vm, uint64_t seed);
+    void record_frame(const Chip8& vm);  // call before each emulate_frame
+    void close();
+
+private:
+    void write_varint(uint64_t value);
+
+    FILE* m_file = NULL;
+    uint64_t m_frame = 0;
+    uint64_t m_last_event = 0;
+    uint8_t m_keys[16];
+};
+
+uint64_t rom_hash(const Chip8& vm);
+int replay(int argc, char** argv);
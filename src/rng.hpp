@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+  xoshiro128++ with splitmix64 seeding, used by CXNN.
+
+  Four words of state per VM, no locks and no globals, so VMs on different
+  threads never contend and a copied VM continues the same stream.
+  See: https://prng.di.unimi.it/xoshiro128plusplus.c
+*/
+
+static inline uint64_t splitmix64(uint64_t& x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static inline void rng_seed(uint32_t* s, uint64_t seed) {
+    // splitmix64 never yields an all-zero state from two consecutive outputs
+    uint64_t a = splitmix64(seed);
+    uint64_t b = splitmix64(seed);
+    s[0] = (uint32_t) a;
+    s[1] = (uint32_t) (a >> 32);
+    s[2] = (uint32_t) b;
+    s[3] = (uint32_t) (b >> 32);
+}
+
+static inline uint32_t rng_rotl(uint32_t x, int k) {
+    return (x << k) | (x >> (32 - k));
+}
+
+static inline uint32_t rng_next(uint32_t* s) {
+    uint32_t result = rng_rotl(s[0] + s[3], 7) + s[0];
+    uint32_t t = s[1] << 9;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rng_rotl(s[3], 11);
+    return result;
+}
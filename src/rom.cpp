@@ -0,0 +1,151 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+
+#include "chip8.hpp"
+#include "disasm.hpp"
+#include "rom.hpp"
+
+uint64_t program_hash(const uint8_t* memory, size_t size) {
+    // FNV-1a over the program window; bytes past the ROM are zero. Zeroes past
+    // 4KB are left out, so a ROM hashes the same in a 4KB or a 64KB image.
+    while (size > 4096 && memory[size - 1] == 0)
+        size--;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0x200; i < size; i++) {
+        hash = (hash ^ memory[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+bool RomImage::assign(const unsigned char* data, long size) {
+    if (size <= 0 || size > MAX_XO_ROM_SIZE) {
+        fprintf(stderr, "ROM is %ld bytes; it must fit 0x200-0xFFFF (%d bytes)\n", size, MAX_XO_ROM_SIZE);
+        return false;
+    }
+    m_image.assign(size > MAX_ROM_SIZE ? XO_MEMORY_SIZE : VM_MEMORY_SIZE, 0);
+    load_fonts(m_image.data());
+    memcpy(m_image.data() + 0x200, data, size);
+    m_size = size;
+    m_variant = detect_variant(m_image.data(), size);
+    if (m_variant == Variant::XoChip)
+        m_image.resize(XO_MEMORY_SIZE, 0);
+    m_hash = program_hash(m_image.data(), m_image.size());
+    return true;
+}
+
+bool RomImage::open(const char* path) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open rom %s\n", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        fprintf(stderr, "%s is not a regular file\n", path);
+        ::close(fd);
+        return false;
+    }
+    if (st.st_size == 0 || st.st_size > MAX_XO_ROM_SIZE) {
+        fprintf(stderr, "ROM is %lld bytes; it must fit 0x200-0xFFFF (%d bytes)\n", (long long) st.st_size, MAX_XO_ROM_SIZE);
+        ::close(fd);
+        return false;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Failed to map rom %s\n", path);
+        return false;
+    }
+    bool ok = assign((const unsigned char*) map, st.st_size);
+    munmap(map, st.st_size);
+    return ok;
+}
+
+bool RomDb::load(const char* path) {
+    std::ifstream in(path);
+    if (!in) {
+        fprintf(stderr, "Failed to open ROM database %s\n", path);
+        return false;
+    }
+    std::string line;
+    int number = 0;
+    while (std::getline(in, line)) {
+        number++;
+        line = line.substr(0, line.find('#'));
+        char name[256];
+        unsigned long long hash;
+        int consumed = 0;
+        if (sscanf(line.c_str(), " %llx %255s %n", &hash, name, &consumed) < 2) {
+            if (line.find_first_not_of(" \t\r") != std::string::npos)
+                fprintf(stderr, "%s:%d: expected '<hash> <name> [settings]'\n", path, number);
+            continue;
+        }
+
+        RomProfile profile;
+        profile.name = name;
+        const char* rest = line.c_str() + consumed;
+        char setting[64];
+        int n;
+        while (sscanf(rest, " %63s%n", setting, &n) == 1) {
+            rest += n;
+            if (!strncmp(setting, "cycles=", 7))
+                profile.cycles_per_frame = atoi(setting + 7);
+            else if (!strcmp(setting, "shift_vy"))
+                profile.quirks.shift_vy = true;
+            else if (!strcmp(setting, "load_store_inc"))
+                profile.quirks.load_store_inc = true;
+            else if (!strcmp(setting, "schip"))
+                profile.variant = Variant::SuperChip;
+            else if (!strcmp(setting, "xochip"))
+                profile.variant = Variant::XoChip;
+            else
+                fprintf(stderr, "%s:%d: unknown setting %s\n", path, number, setting);
+        }
+        m_profiles[hash] = profile;
+    }
+    return true;
+}
+
+const RomProfile* RomDb::find(uint64_t hash) const {
+    auto it = m_profiles.find(hash);
+    return it == m_profiles.end() ? NULL : &it->second;
+}
+
+const char* romdb_path(const char* option) {
+    return option != NULL ? option : getenv("CHIP8_ROMDB");
+}
+
+bool configure_rom(Chip8& vm, const char* option) {
+    if (vm.variant != Variant::Chip8)
+        fprintf(stderr, "ROM uses %s instructions\n", variant_name(vm.variant));
+
+    const char* path = romdb_path(option);
+    if (path == NULL)
+        return true;
+    RomDb db;
+    if (!db.load(path))
+        return false;
+    const RomProfile* profile = configure_rom(vm, db);
+    if (profile == NULL) {
+        fprintf(stderr, "ROM %016llx is not in %s, using defaults\n",
+                (unsigned long long) program_hash(vm.memory, vm.memory.size()), path);
+        return true;
+    }
+    fprintf(stderr, "Identified %s (%d cycles/frame%s%s%s)\n", profile->name.c_str(), vm.cycles_per_frame,
+            vm.quirks.shift_vy ? ", shift_vy" : "", vm.quirks.load_store_inc ? ", load_store_inc" : "",
+            vm.variant == Variant::SuperChip ? ", schip" : vm.variant == Variant::XoChip ? ", xochip" : "");
+    return true;
+}
+
+const RomProfile* configure_rom(Chip8& vm, const RomDb& db) {
+    const RomProfile* profile = db.find(program_hash(vm.memory, vm.memory.size()));
+    if (profile != NULL)
+        vm.set_profile(*profile);
+    return profile;
+}
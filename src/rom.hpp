@@ -0,0 +1,80 @@
+#pragma once
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "decode.hpp"
+
+/*
+  ROM images and the ROM database.
+
+  RomImage maps a ROM file read-only, checks that it fits the program
+  window, and builds the VM's pristine memory image (fonts plus ROM) once.
+  Chip8::reset(image) then restarts a session with a single memcpy and no
+  file I/O. The image is 4KB, or 64KB for XO-CHIP ROMs (larger than 0xE00
+  bytes, or using XO-CHIP instructions; see detect_variant()). It is
+  identified by hash(), FNV-1a over the program window, which is also the
+  ROM hash stored in input logs.
+
+  RomDb maps those hashes to per-ROM settings. One ROM per line, '#' starts
+  a comment:
+    <hash> <name> [cycles=N] [shift_vy] [load_store_inc] [schip] [xochip]
+  e.g.
+    6d2b8a4c0f1e9a37 blinky cycles=20 shift_vy load_store_inc
+  The database is read from --romdb or the CHIP8_ROMDB environment variable.
+  'schip' and 'xochip' force a variant for ROMs whose extended instructions
+  detect_variant() cannot reach statically (e.g. behind self-modifying jumps).
+*/
+
+class Chip8;
+
+struct Quirks {
+    bool shift_vy = false;        // 8XY6/8XYE shift VY into VX, as on the COSMAC VIP
+    bool load_store_inc = false;  // FX55/FX65 leave I at I + X + 1
+};
+
+struct RomProfile {
+    std::string name;
+    Quirks quirks;
+    int cycles_per_frame = 0;  // 0 keeps the default
+    Variant variant = Variant::Chip8;  // raises, never lowers, the detected variant
+};
+
+class RomImage {
+public:
+    bool open(const char* path);
+    bool assign(const unsigned char* data, long size);
+    const uint8_t* image() const { return m_image.data(); }
+    size_t image_size() const { return m_image.size(); }  // 4096, or 65536 for XO-CHIP
+    const uint8_t* data() const { return m_image.data() + 0x200; }
+    long size() const { return m_size; }
+    uint64_t hash() const { return m_hash; }
+    Variant variant() const { return m_variant; }  // instruction set the code needs
+
+private:
+    std::vector<uint8_t> m_image;
+    long m_size = 0;
+    uint64_t m_hash = 0;
+    Variant m_variant = Variant::Chip8;
+};
+
+class RomDb {
+public:
+    bool load(const char* path);
+    const RomProfile* find(uint64_t hash) const;
+    size_t size() const { return m_profiles.size(); }
+
+private:
+    std::map<uint64_t, RomProfile> m_profiles;
+};
+
+uint64_t program_hash(const uint8_t* memory, size_t size);
+const char* romdb_path(const char* option);
+// Looks the loaded ROM up in the database (if one is configured) and applies
+// its profile on top of the variant load_file() or load_rom() set
+bool configure_rom(Chip8& vm, const char* option);
+// The same against a database loaded once, for runners that load many ROMs;
+// prints nothing and returns the profile applied, or NULL
+const RomProfile* configure_rom(Chip8& vm, const RomDb& db);
@@ -0,0 +1,110 @@
+#include "shm.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static std::string shm_name(const char* name) {
+    // shm_open names start with a single slash
+    return name[0] == '/' ? std::string(name) : "/" + std::string(name);
+}
+
+FrameExport::~FrameExport() {
+    close();
+}
+
+bool FrameExport::open(const char* name) {
+    m_name = shm_name(name);
+    int fd = shm_open(m_name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        perror("shm_open");
+        return false;
+    }
+    if (ftruncate(fd, sizeof(SharedFrame)) < 0) {
+        perror("ftruncate");
+        ::close(fd);
+        shm_unlink(m_name.c_str());
+        return false;
+    }
+    void* addr = mmap(NULL, sizeof(SharedFrame), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        perror("mmap");
+        shm_unlink(m_name.c_str());
+        return false;
+    }
+
+    m_shared = (SharedFrame*) addr;
+    m_shared->seq.store(0, std::memory_order_relaxed);
+    m_shared->width = 64;
+    m_shared->height = 32;
+    m_shared->frame = 0;
+    m_shared->version = CHIP8_SHM_VERSION;
+    // Readers check the magic last, once the header is valid
+    std::atomic_thread_fence(std::memory_order_release);
+    m_shared->magic = CHIP8_SHM_MAGIC;
+    return true;
+}
+
+void FrameExport::publish(const Chip8& vm, uint64_t frame) {
+    if (m_shared == NULL)
+        return;
+    uint32_t seq = m_shared->seq.load(std::memory_order_relaxed);
+    m_shared->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_shared->frame = frame;
+    memcpy(m_shared->key, vm.key, sizeof(m_shared->key));
+    vm.copy_lores(m_shared->gfx);
+
+    m_shared->seq.store(seq + 2, std::memory_order_release);
+}
+
+void FrameExport::close() {
+    if (m_shared == NULL)
+        return;
+    munmap(m_shared, sizeof(SharedFrame));
+    shm_unlink(m_name.c_str());
+    m_shared = NULL;
+}
+
+FrameReader::~FrameReader() {
+    if (m_shared != NULL)
+        munmap((void*) m_shared, sizeof(SharedFrame));
+}
+
+bool FrameReader::open(const char* name) {
+    int fd = shm_open(shm_name(name).c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    void* addr = mmap(NULL, sizeof(SharedFrame), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+    m_shared = (const SharedFrame*) addr;
+    return true;
+}
+
+bool FrameReader::read(SharedFrame* out) const {
+    if (m_shared == NULL || m_shared->magic != CHIP8_SHM_MAGIC)
+        return false;
+    uint32_t before;
+    uint32_t after;
+    do {
+        before = m_shared->seq.load(std::memory_order_acquire);
+        if (before & 1)
+            continue;
+        out->width = m_shared->width;
+        out->height = m_shared->height;
+        out->frame = m_shared->frame;
+        memcpy(out->key, m_shared->key, sizeof(out->key));
+        memcpy(out->gfx, m_shared->gfx, sizeof(out->gfx));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = m_shared->seq.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+
+    out->magic = CHIP8_SHM_MAGIC;
+    out->version = m_shared->version;
+    out->seq.store(before, std::memory_order_relaxed);
+    return before != 0;
+}
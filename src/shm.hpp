@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "chip8.hpp"
+
+/*
+  Shared-memory framebuffer export.
+
+  Each completed frame is published into a POSIX shared-memory segment
+  (shm_open) guarded by a seqlock, so other processes can read frames without
+  copies through the emulator, sockets, or slowing it down. The writer never
+  waits: a reader retries if it raced an update.
+
+  Reader side, in any process:
+
+      FrameReader reader;
+      reader.open("/chip8");
+      SharedFrame frame;
+      if (reader.read(&frame)) { ... frame.gfx ... }
+*/
+
+#define CHIP8_SHM_MAGIC 0x38504843  // "CHP8"
+#define CHIP8_SHM_VERSION 1
+
+struct SharedFrame {
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> seq;  // odd while the writer is mid-update
+    uint32_t width;
+    uint32_t height;
+    uint64_t frame;             // frame counter
+    uint8_t key[16];            // keypad state
+    uint8_t gfx[64*32];         // one byte per pixel, 1=white
+};
+
+class FrameExport {
+public:
+    ~FrameExport();
+    bool open(const char* name);
+    void publish(const Chip8& vm, uint64_t frame);
+    void close();
+
+private:
+    std::string m_name;
+    SharedFrame* m_shared = NULL;
+};
+
+class FrameReader {
+public:
+    ~FrameReader();
+    bool open(const char* name);
+    // Copy out the latest consistent frame; false if no frame has been published
+    bool read(SharedFrame* out) const;
+
+private:
+    const SharedFrame* m_shared = NULL;
+};
@@ -0,0 +1,47 @@
+#include "stepper.hpp"
+
+Stepper& Stepper::operator=(Stepper&& other) noexcept {
+    if (this != &other) {
+        if (m_handle)
+            m_handle.destroy();
+        m_handle = std::exchange(other.m_handle, nullptr);
+    }
+    return *this;
+}
+
+Stepper::~Stepper() {
+    if (m_handle)
+        m_handle.destroy();
+}
+
+YieldReason Stepper::resume() {
+    if (done())
+        return YieldReason::Trap;
+    m_handle.resume();
+    if (m_handle.done())
+        return YieldReason::Trap;
+    return m_handle.promise().reason;
+}
+
+Stepper run(Chip8& vm, unsigned yield_mask) {
+    while (true) {
+        for (int i = 0; i < vm.cycles_per_frame; i++) {
+            Status status = vm.emulate_cycle();
+
+            // A trap finishes the coroutine, so done() is true as soon as
+            // resume() has reported it
+            if (vm.trapped)
+                co_return;
+            if (vm.drawFlag && (yield_mask & YIELD_ON_DRAW)) {
+                vm.drawFlag = false;
+                co_yield YieldReason::Draw;
+            }
+            if (status == Status::WaitingForKey && (yield_mask & YIELD_ON_KEYWAIT)) {
+                co_yield YieldReason::KeyWait;
+            }
+        }
+        if (vm.check_faults() != Status::Ok)
+            co_return;
+        co_yield YieldReason::Frame;
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <coroutine>
+#include <utility>
+
+#include "chip8.hpp"
+
+/*
+  Coroutine stepping API.
+
+  run() drives a Chip8 through emulate_cycle and suspends at natural yield
+  points, so one host thread can multiplex many VMs without callbacks or a
+  thread per VM. A suspended VM costs nothing until it is resumed.
+
+      Stepper stepper = run(vm);
+      while (!stepper.done()) {
+          switch (stepper.resume()) { ... }
+      }
+*/
+
+enum class YieldReason {
+    Frame,    // vm.cycles_per_frame cycles have run
+    KeyWait,  // blocked on FX0A; resuming re-polls the keypad
+    Draw,     // the screen changed; drawFlag has been consumed
+    Trap,     // the VM raised a fault (see Chip8::fault); the stepper is done
+};
+
+// Yield points to suspend at; Frame and Trap are always reported
+#define YIELD_ON_KEYWAIT 0x1
+#define YIELD_ON_DRAW    0x2
+#define YIELD_ON_ALL     (YIELD_ON_KEYWAIT | YIELD_ON_DRAW)
+
+class Stepper {
+public:
+    struct promise_type {
+        YieldReason reason = YieldReason::Frame;
+
+        Stepper get_return_object() {
+            return Stepper(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(YieldReason r) noexcept {
+            reason = r;
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception() { throw; }
+    };
+
+    Stepper(Stepper&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+    Stepper& operator=(Stepper&& other) noexcept;
+    Stepper(const Stepper&) = delete;
+    Stepper& operator=(const Stepper&) = delete;
+    ~Stepper();
+
+    // Run until the next yield point and report why it stopped. Trap is
+    // reported once, by the resume() that leaves the stepper done
+    YieldReason resume();
+    bool done() const { return !m_handle || m_handle.done(); }
+
+private:
+    explicit Stepper(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+Stepper run(Chip8& vm, unsigned yield_mask = YIELD_ON_ALL);
@@ -0,0 +1,205 @@
+#include "stream.hpp"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// A viewer this far behind is resynced with a keyframe instead of queueing more deltas
+#define MAX_PENDING_BYTES (64 * 1024)
+
+FrameStream::~FrameStream() {
+    close();
+}
+
+bool FrameStream::listen(const char* address) {
+    if (!strncmp(address, "unix:", 5)) {
+        struct sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (strlen(address + 5) >= sizeof(addr.sun_path)) {
+            fprintf(stderr, "Socket path too long: %s\n", address + 5);
+            return false;
+        }
+        strcpy(addr.sun_path, address + 5);
+        // Replace a stale socket from an earlier run, never anything else
+        struct stat st;
+        if (lstat(addr.sun_path, &st) == 0) {
+            if (!S_ISSOCK(st.st_mode)) {
+                fprintf(stderr, "%s exists and is not a socket\n", addr.sun_path);
+                return false;
+            }
+            unlink(addr.sun_path);
+        }
+
+        m_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (m_listen_fd < 0 || bind(m_listen_fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+            perror("bind");
+            close();
+            return false;
+        }
+        m_unix_path = addr.sun_path;
+    } else if (!strncmp(address, "tcp:", 4)) {
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(address + 4));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        m_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        if (m_listen_fd >= 0)
+            setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (m_listen_fd < 0 || bind(m_listen_fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+            perror("bind");
+            close();
+            return false;
+        }
+    } else {
+        fprintf(stderr, "Stream address must be unix:PATH or tcp:PORT\n");
+        return false;
+    }
+
+    if (::listen(m_listen_fd, 16) < 0) {
+        perror("listen");
+        close();
+        return false;
+    }
+    fcntl(m_listen_fd, F_SETFL, fcntl(m_listen_fd, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+void FrameStream::poll(Chip8* vm) {
+    if (m_listen_fd < 0)
+        return;
+
+    int fd;
+    while ((fd = accept(m_listen_fd, NULL, NULL)) >= 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        m_clients.push_back(Client{fd, std::string(), 0, {0, 0}, 0});
+        queue_keyframe(m_clients.back());
+    }
+
+    for (size_t i = 0; i < m_clients.size();) {
+        Client& client = m_clients[i];
+        bool alive = true;
+        uint8_t buf[64];
+        ssize_t n;
+        while ((n = recv(client.fd, buf, sizeof(buf), 0)) > 0) {
+            for (ssize_t j = 0; j < n; j++) {
+                client.in[client.in_len++] = buf[j];
+                if (client.in_len == 2) {
+                    vm->set_key(client.in[0] & 0xF, client.in[1] != 0);
+                    client.in_len = 0;
+                }
+            }
+        }
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+            alive = false;
+        if (alive)
+            alive = flush(client);
+
+        if (!alive) {
+            ::close(client.fd);
+            m_clients.erase(m_clients.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
+
+void FrameStream::send_frame(const Chip8& vm) {
+    uint8_t frame[STREAM_FRAME_BYTES];
+    vm.pack_gfx(frame);
+
+    // Build the delta once for every viewer
+    uint8_t delta[1 + 4 + STREAM_FRAME_BYTES];
+    uint32_t mask = 0;
+    int len = 5;
+    for (int row = 0; row < 32; row++) {
+        const uint8_t* cur = &frame[row * STREAM_ROW_BYTES];
+        const uint8_t* prev = &m_prev[row * STREAM_ROW_BYTES];
+        if (memcmp(cur, prev, STREAM_ROW_BYTES) == 0)
+            continue;
+        mask |= 1u << row;
+        for (int i = 0; i < STREAM_ROW_BYTES; i++) {
+            delta[len++] = cur[i] ^ prev[i];
+        }
+    }
+    memcpy(m_prev, frame, sizeof(m_prev));
+    if (mask == 0)
+        return;
+    delta[0] = 'D';
+    for (int i = 0; i < 4; i++) {
+        delta[1 + i] = (mask >> (8 * i)) & 0xFF;
+    }
+
+    for (size_t i = 0; i < m_clients.size();) {
+        Client& client = m_clients[i];
+        if (client.out.size() > MAX_PENDING_BYTES) {
+            // Drop every message the socket has not started; the one in flight has to finish
+            client.out.resize(client.partial);
+            queue_keyframe(client);
+        } else {
+            client.out.append((const char*) delta, len);
+        }
+        if (!flush(client)) {
+            ::close(client.fd);
+            m_clients.erase(m_clients.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
+
+void FrameStream::queue_keyframe(Client& client) {
+    client.out += 'K';
+    client.out.append((const char*) m_prev, sizeof(m_prev));
+}
+
+// Messages describe their own size, so boundaries in a queue can be found by walking it
+static size_t message_length(const std::string& out, size_t pos) {
+    if (out[pos] == 'K')
+        return 1 + STREAM_FRAME_BYTES;
+    uint32_t mask = 0;
+    for (int i = 0; i < 4; i++) {
+        mask |= (uint32_t) (uint8_t) out[pos + 1 + i] << (8 * i);
+    }
+    return 5 + STREAM_ROW_BYTES * __builtin_popcount(mask);
+}
+
+bool FrameStream::flush(Client& client) {
+    while (!client.out.empty()) {
+        ssize_t n = send(client.fd, client.out.data(), client.out.size(), 0);
+        if (n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        size_t boundary = client.partial;
+        while (boundary < (size_t) n) {
+            boundary += message_length(client.out, boundary);
+        }
+        client.partial = boundary - n;
+        client.out.erase(0, n);
+    }
+    return true;
+}
+
+void FrameStream::close() {
+    for (auto& client : m_clients) {
+        ::close(client.fd);
+    }
+    m_clients.clear();
+    if (m_listen_fd >= 0) {
+        ::close(m_listen_fd);
+        m_listen_fd = -1;
+    }
+    if (!m_unix_path.empty()) {
+        unlink(m_unix_path.c_str());
+        m_unix_path.clear();
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "chip8.hpp"
+
+/*
+  Delta-encoded frame stream over a Unix or localhost TCP socket.
+
+  Address: "unix:/path/to/socket" or "tcp:PORT" (bound to 127.0.0.1).
+
+  Server to client, one message per frame that drew:
+    'K' + 256 bytes        keyframe: bit-packed framebuffer, 8 bytes per row,
+                           leftmost pixel in the high bit
+    'D' + u32 row mask     delta: little-endian mask of changed rows, then
+        + 8 bytes per row  the XOR of each changed row against the previous
+                           frame, in row order
+  A client receives a keyframe on connect and after falling too far behind;
+  everything else is deltas.
+
+  Client to server:
+    2 bytes                keypad event: key index 0-15, then 1=down / 0=up
+
+  A viewer that disconnects mid-send must not kill the process: sockets get
+  SO_NOSIGPIPE where the platform has it, elsewhere the process has to
+  ignore SIGPIPE (main does).
+*/
+
+#define STREAM_ROW_BYTES (64 / 8)
+#define STREAM_FRAME_BYTES (STREAM_ROW_BYTES * 32)
+
+class FrameStream {
+public:
+    ~FrameStream();
+    bool listen(const char* address);
+    // Accept new viewers and apply their input to the VM
+    void poll(Chip8* vm);
+    // Send the frame to every viewer; call when drawFlag is set
+    void send_frame(const Chip8& vm);
+    void close();
+
+private:
+    struct Client {
+        int fd;
+        std::string out;   // bytes not yet accepted by the socket
+        size_t partial;    // leading bytes of out that finish a message already partly sent
+        uint8_t in[2];
+        int in_len;
+    };
+
+    void queue_keyframe(Client& client);
+    bool flush(Client& client);
+
+    int m_listen_fd = -1;
+    std::string m_unix_path;
+    std::vector<Client> m_clients;
+    uint8_t m_prev[STREAM_FRAME_BYTES] = {};  // last frame sent; the viewers' baseline
+};
@@ -1,8 +1,14 @@
 #include "tests.hpp"
+#include "batch_vm.hpp"
+#include "decode.hpp"
+#include "disasm.hpp"
+#include "env.hpp"
+#include "stepper.hpp"
+#include "trace.hpp"
 
 #include <iostream>
 
-#define ASSERT_TRUE(x) { if (!(x)) std::cout << __FUNCTION__ << " failed on line " << __LINE__ << std::endl; }
+#define ASSERT_TRUE(x) { if (!(x)) { std::cout << __FUNCTION__ << " failed on line " << __LINE__ << std::endl; m_failures++; } }
 
 Tests::Tests(bool debug) {
     vm = Chip8(debug);
@@ -10,10 +16,13 @@ Tests::Tests(bool debug) {
 };
 
 void Tests::reset() {
+    vm.set_variant(Variant::Chip8);
     vm.init();
+    vm.quirks = Quirks();
+    vm.fatal_faults = 0;
 }
 
-void Tests::run_tests() {
+int Tests::run_tests() {
     test_00EE();
     reset();
 
@@ -74,6 +83,9 @@ void Tests::run_tests() {
     test_BNNN();
     reset();
 
+    test_CXNN();
+    reset();
+
     test_EX9E();
     reset();
 
@@ -106,6 +118,71 @@ void Tests::run_tests() {
 
     test_FX65();
     reset();
+
+    test_00CN();
+    reset();
+
+    test_00FB();
+    reset();
+
+    test_00FC();
+    reset();
+
+    test_00FF();
+    reset();
+
+    test_DXY0();
+    reset();
+
+    test_FX30();
+    reset();
+
+    test_FX75();
+    reset();
+
+    test_00DN();
+    reset();
+
+    test_5XY2();
+    reset();
+
+    test_F000();
+    reset();
+
+    test_FN01();
+    reset();
+
+    test_F002();
+    reset();
+
+    test_faults();
+    reset();
+
+    test_data_access();
+    reset();
+
+    test_frame_count();
+    reset();
+
+    test_stepper();
+    reset();
+
+    test_batch_vm();
+    reset();
+
+    test_vec_env();
+    reset();
+
+    test_trace();
+    reset();
+
+    test_decode();
+    reset();
+
+    test_disasm();
+    reset();
+
+    return m_failures;
 }
 
 bool Tests::test_00E0() {
@@ -140,6 +217,18 @@ bool Tests::test_00EE() {
     // Assertions
     ASSERT_TRUE(vm.sp == 0);
     ASSERT_TRUE(vm.pc == 0xFFF2);
+
+    // Setup, case 2 return with an empty stack traps
+    reset();
+    vm.load(opcode, 2);
+
+    // Run
+    vm.emulate_cycle();
+
+    // Assertions
+    ASSERT_TRUE(vm.trapped);
+    ASSERT_TRUE(vm.fault == Status::StackUnderflow);
+    ASSERT_TRUE(vm.pc == 0x200);
     return true;
 }
 
@@ -167,6 +256,19 @@ bool Tests::test_2NNN() {
     // Assertions
     ASSERT_TRUE(vm.pc == 0x0FFF);
     ASSERT_TRUE(vm.stack[0] == 0x0200);
+
+    // Setup, case 2 calling with a full stack traps
+    reset();
+    vm.load(opcode, 2);
+    vm.sp = 16;
+
+    // Run
+    vm.emulate_cycle();
+
+    // Assertions
+    ASSERT_TRUE(vm.trapped);
+    ASSERT_TRUE(vm.fault == Status::StackOverflow);
+    ASSERT_TRUE(vm.pc == 0x200);
     return true;
 }
 
@@ -430,6 +532,18 @@ bool Tests::test_8XY6() {
     ASSERT_TRUE(vm.V[1] == (0xFF >> 1));
     ASSERT_TRUE(vm.V[0xF] == 1);
     ASSERT_TRUE(vm.pc == 0x200 + 2);
+
+    // Case 2: shift_vy quirk, restarted from a ROM image
+    RomImage rom;
+    rom.assign(opcode, 2);
+    vm.reset(rom);
+    vm.quirks.shift_vy = true;
+    vm.V[0x1] = 0xFF;
+    vm.V[0x2] = 0x0E;
+    vm.emulate_cycle();
+    ASSERT_TRUE(vm.V[1] == 0x07);
+    ASSERT_TRUE(vm.V[0xF] == 0);
+    ASSERT_TRUE(vm.pc == 0x200 + 2);
     return true;
 }
 
@@ -535,6 +649,40 @@ bool Tests::test_BNNN() {
     return true;
 }
 
+bool Tests::test_CXNN() {
+    // Setup, case 1 result is masked by NN
+    unsigned char opcode[] = {0xC1, 0x0F};
+    vm.seed(1);
+    vm.load(opcode, 2);
+
+    // Run
+    vm.emulate_cycle();
+
+    // Assertions
+    ASSERT_TRUE(vm.pc == 0x200 + 2);
+    ASSERT_TRUE((vm.V[1] & 0xF0) == 0);
+
+    // Setup, case 2 the same seed gives the same stream
+    unsigned char sequence[] = {0xC1, 0xFF, 0xC2, 0xFF, 0xC3, 0xFF};
+    uint8_t first[3];
+    for (int run = 0; run < 2; run++) {
+        reset();
+        vm.seed(42);
+        vm.load(sequence, 6);
+        vm.emulate_cycle();
+        vm.emulate_cycle();
+        vm.emulate_cycle();
+        if (run == 0) {
+            memcpy(first, &vm.V[1], 3);
+        }
+    }
+
+    // Assertions
+    ASSERT_TRUE(memcmp(first, &vm.V[1], 3) == 0);
+    ASSERT_TRUE(!(first[0] == first[1] && first[1] == first[2]));
+    return true;
+}
+
 bool Tests::test_EX9E() {
     // Setup, case 1 key is pressed
     unsigned char opcode[] = {0xE1, 0x9E};
@@ -610,14 +758,17 @@ bool Tests::test_FX0A() {
     vm.load(opcode, 2);
 
     // Run
+    Status status[3];
     for (int i = 0; i < 3; i++) {
         if (i == 2) {
             vm.set_key(1, true);
         }
-        vm.emulate_cycle();
+        status[i] = vm.emulate_cycle();
     }
 
     // Assertions
+    ASSERT_TRUE(status[0] == Status::WaitingForKey);
+    ASSERT_TRUE(status[2] == Status::Ok);
     ASSERT_TRUE(vm.V[1] == 1);
     ASSERT_TRUE(vm.pc == 0x200 + 2);
     return true;
@@ -704,6 +855,33 @@ bool Tests::test_FX33() {
     ASSERT_TRUE(vm.memory[vm.I+1] == 5);
     ASSERT_TRUE(vm.memory[vm.I+2] == 0);
     ASSERT_TRUE(vm.pc == 0x200 + 2);
+
+    // Case 2: VMs sharing an arena image see only their own writes
+    RomImage image;
+    image.assign(opcode, 2);
+    RomArena arena;
+    auto rom = arena.add(image);
+    ASSERT_TRUE(rom != nullptr && arena.add(image) == rom);
+    Chip8 other;
+    vm.reset(*rom);
+    other.reset(*rom);
+    vm.I = other.I = 0x300;
+    vm.V[1] = 150;
+    vm.emulate_cycle();
+    ASSERT_TRUE(vm.memory[0x300] == 1);
+    ASSERT_TRUE(other.memory[0x300] == 0);
+    ASSERT_TRUE(other.memory[0x200] == 0xF1);
+    vm.reset(*rom);
+    ASSERT_TRUE(vm.memory[0x300] == 0);
+
+    // Case 3: copies are private, moves keep the contents
+    Chip8 copy = other;
+    copy.memory[0x300] = 7;
+    ASSERT_TRUE(!copy.memory.shared() && other.memory[0x300] == 0);
+    Chip8 moved = std::move(copy);
+    ASSERT_TRUE(moved.memory[0x300] == 7 && moved.memory[0x200] == 0xF1);
+    moved.set_variant(Variant::XoChip);
+    ASSERT_TRUE(moved.memory.size() == 65536 && moved.memory[0x300] == 7);
     return true;
 }
 
@@ -726,6 +904,12 @@ bool Tests::test_FX55() {
         ASSERT_TRUE(vm.memory[vm.I+i] == i);
     }
     ASSERT_TRUE(vm.pc == 0x200 + 2);
+
+    // Case 2: load_store_inc quirk leaves I past the last register
+    vm.quirks.load_store_inc = true;
+    vm.pc = 0x200;
+    vm.emulate_cycle();
+    ASSERT_TRUE(vm.I == 5 + 9);
     return true;
 }
 
@@ -749,3 +933,628 @@ bool Tests::test_FX65() {
     ASSERT_TRUE(vm.pc == 0x200 + 2);
     return true;
 }
+
+bool Tests::test_00CN() {
+    // Setup: SUPER-CHIP scrolls in pixels of the current mode
+    unsigned char opcode[] = {0x00, 0xC3, 0x00, 0xFF, 0x00, 0xC2};
+    vm.load(opcode, 6);
+    vm.set_variant(Variant::SuperChip);
+    vm.gfx[5] = 1;
+
+    // Run: lo-res, three rows down
+    vm.emulate_cycle();
+
+    // Assertions
+    ASSERT_TRUE(vm.gfx[5] == 0);
+    ASSERT_TRUE(vm.gfx[3 * 64 + 5] == 1);
+    ASSERT_TRUE(vm.drawFlag == true);
+    ASSERT_TRUE(vm.pc == 0x200 + 2);
+
+    // Run: hi-res, two rows down
+    vm.emulate_cycle();
+    vm.gfx[10] = 1;
+    vm.gfx[63 * 128 + 10] = 1;
+    vm.emulate_cycle();
+
+    // Assertions: the bottom rows fall off
+    ASSERT_TRUE(vm.gfx[10] == 0);
+    ASSERT_TRUE(vm.gfx[2 * 128 + 10] == 1);
+    ASSERT_TRUE(vm.gfx[63 * 128 + 10] == 0);
+    ASSERT_TRUE(vm.pc == 0x200 + 6);
+
+    // Plain CHIP-8 traps on it
+    reset();
+    vm.load(opcode, 2);
+    ASSERT_TRUE(vm.emulate_cycle() == Status::IllegalOpcode);
+    return true;
+}
+
+bool Tests::test_00FB() {
+    // Setup
+    unsigned char opcode[] = {0x00, 0xFB};
+    vm.load(opcode, 2);
+    vm.set_variant(Variant::SuperChip);
+    vm.gfx[64 + 0] = 1;
+    vm.gfx[64 + 62] = 1;
+
+    // Run
+    vm.emulate_cycle();
+
+    // Assertions: pixels move 4 right within their row, the right edge falls off
+    ASSERT_TRUE(vm.gfx[64 + 0] == 0);
+    ASSERT_TRUE(vm.gfx[64 + 4] == 1);
+    ASSERT_TRUE(vm.gfx[128 + 2] == 0);
+    ASSERT_TRUE(vm.pc == 0x200 + 2);
+    return true;
+}
+
+bool Tests::test_00FC() {
+    // Setup
+    unsigned char opcode[] = {0x00, 0xFC};
+    vm.load(opcode, 2);
+    vm.set_variant(Variant::SuperChip);
+    vm.gfx[64 + 1] = 1;
+    vm.gfx[64 + 63] = 1;
+
+    // Run
+    vm.emulate_cycle();
+
+    // Assertions: pixels move 4 left within their row, the left edge falls off
+    ASSERT_TRUE(vm.gfx[64 + 59] == 1);
+    ASSERT_TRUE(vm.gfx[64 + 63] == 0);
+    ASSERT_TRUE(vm.gfx[61] == 0);
+    ASSERT_TRUE(vm.gfx[64 + 1] == 0);
+    ASSERT_TRUE(vm.pc == 0x200 + 2);
+    return true;
+}
+
+bool Tests::test_00FF() {
+    // Setup: 00FF, DXY1 at (127, 63), 00FE
+    unsigned char opcode[] = {0x00, 0xFF, 0xD0, 0x11, 0x00, 0xFE};
+    vm.load(opcode, 6);
+    vm.set_variant(Variant::SuperChip);
+    vm.gfx[0] = 1;
+    vm.V[0] = 127;
+    vm.V[1] = 63;
+    vm.I = 0x300;
+    vm.memory[0x300] = 0x80;
+
+    // Run
+    vm.emulate_cycle();
+    ASSERT_TRUE(vm.hires == true);
+    ASSERT_TRUE(vm.width() == 128 && vm.height() == 64);
+    ASSERT_TRUE(vm.gfx[0] == 0);
+    vm.emulate_cycle();
+
+    // Assertions: the pixel lands in the last hi-res byte and downsamples to the last lo-res one
+    ASSERT_TRUE(vm.gfx[128 * 64 - 1] == 1);
+    uint8_t lores[64*32];
+    vm.copy_lores(lores);
+    ASSERT_TRUE(lores[64*32 - 1] == 1);
+    ASSERT_TRUE(lores[0] == 0);
+
+    // Run: back to lo-res clears the screen
+    vm.emulate_cycle();
+    ASSERT_TRUE(vm.hires == false);
+    ASSERT_TRUE(vm.gfx[128 * 64 - 1] == 0);
+    ASSERT_TRUE(vm.pc == 0x200 + 6);
+
+    // Only hi-res capable VMs carry the large buffer, and copies keep it
+    vm.gfx[64 * 32] = 1;
+    Chip8 copy = vm;
+    ASSERT_TRUE(copy.gfx.size() == 128 * 64 && copy.gfx[64 * 32] == 1);
+    vm.set_variant(Variant::Chip8);
+    ASSERT_TRUE(vm.gfx.size() == 64 * 32);
+    return true;
+}
+
+bool Tests::test_DXY0() {
+    // Setup: a 16x16 sprite whose first row is 0x8001
+    unsigned char opcode[] = {0xD0, 0x10};
+    vm.load(opcode, 2);
+    vm.set_variant(Variant::SuperChip);
+    vm.hires = true;
+    vm.V[0] = 8;
+    vm.V[1] = 4;
+    vm.I = 0x300;
+    vm.memory[0x300] = 0x80;
+    vm.memory[0x301] = 0x01;
+    vm.memory[0x31E] = 0xFF;
+    vm.gfx[4 * 128 + 8] = 1;
+
+    // Run
+    vm.emulate_cycle();
+
+    // Assertions
+    ASSERT_TRUE(vm.gfx[4 * 128 + 8] == 0);
+    ASSERT_TRUE(vm.gfx[4 * 128 + 23] == 1);
+    ASSERT_TRUE(vm.gfx[19 * 128 + 8] == 1);
+    ASSERT_TRUE(vm.gfx[19 * 128 + 15] == 1);
+    ASSERT_TRUE(vm.gfx[19 * 128 + 16] == 0);
+    ASSERT_TRUE(vm.V[0xF] == 1);
+    ASSERT_TRUE(vm.pc == 0x200 + 2);
+
+    // Plain CHIP-8 draws nothing for DXY0
+    reset();
+    vm.load(opcode, 2);
+    vm.I = 0x300;
+    vm.memory[0x300] = 0xFF;
+    vm.emulate_cycle();
+    ASSERT_TRUE(vm.gfx[0] == 0);
+    return true;
+}
+
+bool Tests::test_FX30() {
+    // Setup
+    unsigned char opcode[] = {0xF1, 0x30};
+    vm.load(opcode, 2);
+    vm.set_variant(Variant::SuperChip);
+    vm.V[1] = 0x13;
+
+    // Run
+    vm.emulate_cycle();
+
+    // Assertions: the big 3, from the font loaded by init()
+    ASSERT_TRUE(vm.I == SCHIP_FONT_ADDR + 30);
+    ASSERT_TRUE(vm.memory[vm.I] == schip_fontset[30]);
+    ASSERT_TRUE(vm.pc == 0x200 + 2);
+    return true;
+}
+
+bool Tests::test_FX75() {
+    // Setup: save V0-V2, clobber them, restore V0-V1
+    unsigned char opcode[] = {0xF2, 0x75, 0xF1, 0x85};
+    vm.load(opcode, 4);
+    vm.set_variant(Variant::SuperChip);
+    vm.V[0] = 1;
+    vm.V[1] = 2;
+    vm.V[2] = 3;
+
+    // Run
+    vm.emulate_cycle();
+    vm.V[0] = vm.V[1] = vm.V[2] = 0;
+    vm.emulate_cycle();
+
+    // Assertions
+    ASSERT_TRUE(vm.rpl[2] == 3);
+    ASSERT_TRUE(vm.V[0] == 1);
+    ASSERT_TRUE(vm.V[1] == 2);
+    ASSERT_TRUE(vm.V[2] == 0);
+    ASSERT_TRUE(vm.pc == 0x200 + 4);
+
+    // The flags survive init()
+    reset();
+    ASSERT_TRUE(vm.rpl[0] == 1);
+    memset(vm.rpl, 0, sizeof(vm.rpl));
+    return true;
+}
+
+bool Tests::test_00DN() {
+    // Setup: XO-CHIP scrolls only the selected planes
+    unsigned char opcode[] = {0xF1, 0x01, 0x00, 0xD2};
+    vm.load(opcode, 4);
+    vm.set_variant(Variant::XoChip);
+    vm.gfx[5 * 64 + 7] = 3;
+
+    // Run: select plane 1, scroll it up two rows
+    vm.emulate_cycle();
+    vm.emulate_cycle();
+
+    // Assertions: plane 2 stays put
+    ASSERT_TRUE(vm.gfx[3 * 64 + 7] == 1);
+    ASSERT_TRUE(vm.gfx[5 * 64 + 7] == 2);
+    ASSERT_TRUE(vm.drawFlag == true);
+    ASSERT_TRUE(vm.pc == 0x200 + 4);
+    return true;
+}
+
+bool Tests::test_5XY2() {
+    // Setup: store V1-V3, then load them back in reverse into V6-V4
+    unsigned char opcode[] = {0x51, 0x32, 0x56, 0x43};
+    vm.load(opcode, 4);
+    vm.set_variant(Variant::XoChip);
+    vm.V[1] = 1;
+    vm.V[2] = 2;
+    vm.V[3] = 3;
+    vm.I = 0x300;
+
+    // Run
+    vm.emulate_cycle();
+    vm.emulate_cycle();
+
+    // Assertions
+    ASSERT_TRUE(vm.memory[0x300] == 1 && vm.memory[0x301] == 2 && vm.memory[0x302] == 3);
+    ASSERT_TRUE(vm.V[6] == 1 && vm.V[5] == 2 && vm.V[4] == 3);
+    ASSERT_TRUE(vm.I == 0x300);
+    ASSERT_TRUE(vm.pc == 0x200 + 4);
+
+    // Plain CHIP-8 traps on it instead of treating it as 5XY0
+    reset();
+    vm.load(opcode, 2);
+    ASSERT_TRUE(vm.emulate_cycle() == Status::IllegalOpcode);
+    return true;
+}
+
+bool Tests::test_F000() {
+    // Setup: a skip over F000 NNNN, then F000 NNNN into the upper 60KB
+    unsigned char opcode[] = {0x30, 0x00, 0xF0, 0x00, 0x12, 0x34, 0xF0, 0x00, 0xE0, 0x00, 0xF0, 0x65};
+    vm.load(opcode, 12);
+    vm.set_variant(Variant::XoChip);
+    vm.memory[0xE000] = 0x42;
+
+    // Run
+    vm.emulate_cycle();
+    ASSERT_TRUE(vm.pc == 0x200 + 6);
+    vm.emulate_cycle();
+    ASSERT_TRUE(vm.I == 0xE000);
+    ASSERT_TRUE(vm.pc == 0x200 + 10);
+    vm.emulate_cycle();
+
+    // Assertions
+    ASSERT_TRUE(vm.memory.size() == 65536);
+    ASSERT_TRUE(vm.V[0] == 0x42);
+    return true;
+}
+
+bool Tests::test_FN01() {
+    // Setup: both planes, an 8x1 sprite with a different row per plane
+    unsigned char opcode[] = {0xF3, 0x01, 0xD0, 0x01, 0xD0, 0x01};
+    vm.load(opcode, 6);
+    vm.set_variant(Variant::XoChip);
+    vm.I = 0x300;
+    vm.memory[0x300] = 0xC0;
+    vm.memory[0x301] = 0x80;
+
+    // Run
+    vm.emulate_cycle();
+    vm.emulate_cycle();
+
+    // Assertions
+    ASSERT_TRUE(vm.planes == 3);
+    ASSERT_TRUE(vm.gfx[0] == 3);
+    ASSERT_TRUE(vm.gfx[1] == 1);
+    ASSERT_TRUE(vm.V[0xF] == 0);
+    uint32_t pixels[64*32];
+    vm.to_argb(pixels);
+    ASSERT_TRUE(pixels[1] == 0xFFFFFFFF && pixels[0] != pixels[1]);
+
+    // Drawing it again erases both planes and collides
+    vm.emulate_cycle();
+    ASSERT_TRUE(vm.gfx[0] == 0 && vm.gfx[1] == 0);
+    ASSERT_TRUE(vm.V[0xF] == 1);
+    return true;
+}
+
+bool Tests::test_F002() {
+    // Setup
+    unsigned char opcode[] = {0xF0, 0x02, 0xF1, 0x3A};
+    vm.load(opcode, 4);
+    vm.set_variant(Variant::XoChip);
+    vm.I = 0x300;
+    for (int i = 0; i < 16; i++) {
+        vm.memory[0x300 + i] = i * 16;
+    }
+    vm.V[1] = 112;
+
+    // Run
+    vm.emulate_cycle();
+    vm.emulate_cycle();
+
+    // Assertions
+    ASSERT_TRUE(vm.audio_pattern[0] == 0 && vm.audio_pattern[15] == 240);
+    ASSERT_TRUE(vm.pitch == 112);
+    ASSERT_TRUE(vm.pc == 0x200 + 4);
+
+    // init() restores the default pitch
+    reset();
+    ASSERT_TRUE(vm.pitch == 64);
+    return true;
+}
+
+bool Tests::test_faults() {
+    // Setup
+    unsigned char opcode[] = {0xF2, 0x55, 0xF2, 0x65};
+    vm.load(opcode, 4);
+    vm.I = 0xFFE;
+    vm.V[0] = 1; vm.V[1] = 2; vm.V[2] = 3;
+
+    // Run: FX55 wraps its last byte around to address 0
+    vm.emulate_cycle();
+
+    // Assertions
+    ASSERT_TRUE(vm.memory[0xFFF] == 2 && vm.memory[0x000] == 3);
+    ASSERT_TRUE(vm.faults == FAULT_WRITE_WRAP);
+    ASSERT_TRUE(vm.check_faults() == Status::Ok && !vm.trapped);
+
+    // FX65 reads back across the same edge
+    vm.emulate_cycle();
+    ASSERT_TRUE(vm.V[2] == 3);
+    ASSERT_TRUE(vm.faults == (FAULT_READ_WRAP | FAULT_WRITE_WRAP));
+
+    // A fatal bit traps at the next check
+    vm.fatal_faults = FAULT_READ_WRAP;
+    ASSERT_TRUE(vm.check_faults() == Status::AddressWrap);
+    ASSERT_TRUE(vm.trapped && vm.fault == Status::AddressWrap);
+
+    // Accesses that stay in memory leave no bits, and init() clears them
+    reset();
+    vm.load(opcode, 4);
+    vm.I = 0xFFD;
+    vm.emulate_cycle();
+    vm.emulate_cycle();
+    ASSERT_TRUE(vm.faults == 0);
+    return true;
+}
+
+bool Tests::test_data_access() {
+    // Setup
+    unsigned char rom[] = {0xD0, 0x10, 0x51, 0x42, 0xF0, 0x00, 0x12, 0x34, 0xD0, 0x15};
+    vm.load(rom, sizeof(rom));
+    vm.I = 0x300;
+
+    // Assertions: DXY0 reads nothing on CHIP-8, where it traps
+    ASSERT_TRUE(vm.data_access().count == 0);
+    vm.set_variant(Variant::SuperChip);
+    ASSERT_TRUE(vm.data_access().count == 32 && vm.data_access().addr == 0x300);
+
+    vm.set_variant(Variant::XoChip);
+    vm.pc = 0x202;
+    DataAccess save = vm.data_access();
+    ASSERT_TRUE(save.count == 4 && save.writes);
+    vm.pc = 0x204;
+    ASSERT_TRUE(vm.data_access().addr == 0x206 && vm.data_access().count == 2);
+
+    // Two planes read two sprites
+    vm.pc = 0x208;
+    vm.planes = 3;
+    ASSERT_TRUE(vm.data_access().count == 10 && !vm.data_access().writes);
+    return true;
+}
+
+bool Tests::test_frame_count() {
+    // Setup
+    unsigned char rom[] = {0x60, 0x01, 0xF0, 0x0A};
+    vm.load(rom, sizeof(rom));
+
+    // Run: one instruction, then FX0A waits out the rest of the frame
+    int executed = vm.emulate_frame();
+
+    // Assertions
+    ASSERT_TRUE(executed == 1 && vm.pc == 0x202);
+    return true;
+}
+
+bool Tests::test_stepper() {
+    // Setup: draw, wait for a key, then an illegal opcode
+    unsigned char rom[] = {0x00, 0xE0, 0xF0, 0x0A, 0x00, 0x00};
+    vm.load(rom, sizeof(rom));
+    Stepper stepper = run(vm);
+
+    // Run and assert: yields come in program order
+    ASSERT_TRUE(stepper.resume() == YieldReason::Draw && !vm.drawFlag);
+    ASSERT_TRUE(stepper.resume() == YieldReason::KeyWait);
+    ASSERT_TRUE(stepper.resume() == YieldReason::KeyWait);
+    vm.set_key(7, true);
+    int traps = 0, yields = 0;
+    while (!stepper.done()) {
+        traps += stepper.resume() == YieldReason::Trap;
+        yields++;
+    }
+    ASSERT_TRUE(traps == 1 && yields == 1);
+    ASSERT_TRUE(vm.V[0] == 7 && vm.fault == Status::IllegalOpcode);
+
+    // Without the optional yield points a frame runs whole
+    reset();
+    unsigned char loop[] = {0x00, 0xE0, 0x12, 0x02};
+    vm.load(loop, sizeof(loop));
+    Stepper frames = run(vm, 0);
+    ASSERT_TRUE(frames.resume() == YieldReason::Frame && vm.drawFlag);
+    ASSERT_TRUE(frames.resume() == YieldReason::Frame && !frames.done());
+    return true;
+}
+
+bool Tests::test_batch_vm() {
+    // Setup: a random bit sends each lane down one of two paths, then they
+    // meet again and store their own BCD
+    unsigned char rom[] = {
+        0xC0, 0x01,  // 200: V0 = rand & 1
+        0x30, 0x00,  // 202: skip if V0 == 0
+        0x61, 0x05,  // 204: V1 = 5
+        0x71, 0x01,  // 206: V1 += 1
+        0xA3, 0x00,  // 208: I = 0x300
+        0xF1, 0x33,  // 20A: BCD of V1
+        0x12, 0x0C,  // 20C: spin
+    };
+    const int lanes = 8;
+    BatchChip8 batch(lanes);
+    batch.init();
+    batch.load(rom, sizeof(rom));
+    std::vector<Chip8> reference(lanes);
+    for (int l = 0; l < lanes; l++) {
+        batch.seed(l, l + 1);
+        reference[l].init();
+        reference[l].load(rom, sizeof(rom));
+        reference[l].seed(l + 1);
+    }
+
+    // Run: every lane tracks its own reference VM through the split and the regroup
+    for (int step = 0; step < 8; step++) {
+        batch.step();
+        for (int l = 0; l < lanes; l++) {
+            Chip8& ref = reference[l];
+            ref.emulate_cycle();
+            bool same = batch.pc[l] == ref.pc && batch.I[l] == ref.I && batch.V[0][l] == ref.V[0]
+                && batch.V[1][l] == ref.V[1] && batch.mem(l, 0x301) == ref.memory[0x301]
+                && batch.mem(l, 0x302) == ref.memory[0x302] && !batch.trapped[l];
+            ASSERT_TRUE(same);
+        }
+    }
+
+    // Assertions: both paths were taken, so the lanes really diverged
+    int took_skip = 0;
+    for (int l = 0; l < lanes; l++) {
+        took_skip += batch.V[1][l] == 1;
+    }
+    ASSERT_TRUE(took_skip > 0 && took_skip < lanes);
+    ASSERT_TRUE(batch.pc[0] == 0x20C);
+    return true;
+}
+
+static float lit_pixels(const Chip8& vm, int, void*) {
+    uint8_t screen[64*32];
+    vm.copy_lores(screen);
+    int lit = 0;
+    for (int i = 0; i < 64*32; i++) {
+        lit += screen[i];
+    }
+    return lit;
+}
+
+// Runs steps of env from reset(seed); actions cycle through every key and none
+static void run_env(VecEnv& env, uint64_t seed, int steps, std::vector<uint8_t>& obs, std::vector<float>& rewards) {
+    int n = env.num_envs();
+    std::vector<int> actions(n);
+    std::vector<uint8_t> dones(n);
+    obs.assign(n * env.observation_size() * (steps + 1), 0);
+    rewards.assign(n * steps, 0);
+    env.reset(seed, obs.data());
+    for (int s = 0; s < steps; s++) {
+        for (int i = 0; i < n; i++) {
+            actions[i] = (s + i) % 17 - 1;
+        }
+        env.step(actions.data(), &obs[(s + 1) * n * env.observation_size()], &rewards[s * n], dones.data());
+    }
+}
+
+bool Tests::test_vec_env() {
+    // Setup: draws the 0 glyph at random positions forever, in column 0
+    // unless key 5 is held
+    unsigned char rom[] = {
+        0xC0, 0x3F,  // 200: V0 = rand & 63
+        0xC1, 0x1F,  // 202: V1 = rand & 31
+        0x62, 0x05,  // 204: V2 = 5
+        0xE2, 0x9E,  // 206: skip if key V2 is down
+        0x60, 0x00,  // 208: V0 = 0
+        0xA0, 0x00,  // 20A: I = glyph 0
+        0xD0, 0x15,  // 20C: draw at (V0, V1)
+        0x12, 0x00,  // 20E: loop
+    };
+    EnvConfig config;
+    config.max_frames = 8;  // episodes end every two steps, so resets are covered too
+    VecEnv env(rom, sizeof(rom), 4, config);
+    VecEnv other(rom, sizeof(rom), 4, config);
+    ASSERT_TRUE(env.valid() && other.valid());
+    env.set_reward(lit_pixels, NULL);
+    other.set_reward(lit_pixels, NULL);
+
+    // Run
+    std::vector<uint8_t> obs, again, other_obs, reseeded;
+    std::vector<float> rewards, again_rewards, other_rewards, reseeded_rewards;
+    run_env(env, 7, 6, obs, rewards);
+    run_env(env, 7, 6, again, again_rewards);
+    run_env(other, 7, 6, other_obs, other_rewards);
+    run_env(other, 8, 6, reseeded, reseeded_rewards);
+
+    // Assertions: the seed alone decides every observation and reward
+    ASSERT_TRUE(obs == again && rewards == again_rewards);
+    ASSERT_TRUE(obs == other_obs && rewards == other_rewards);
+    ASSERT_TRUE(obs != reseeded);
+    // Envs in a batch get their own streams
+    size_t size = env.observation_size();
+    ASSERT_TRUE(memcmp(&obs[4 * size], &obs[5 * size], size) != 0);
+    return true;
+}
+
+bool Tests::test_trace() {
+    // Setup: six instructions into a ring of four
+    unsigned char rom[] = {0x60, 0x09, 0x61, 0x0A, 0x62, 0x0B, 0xA3, 0x00, 0xF2, 0x65, 0x80, 0x14};
+    vm.load(rom, sizeof(rom));
+    vm.memory[0x300] = 1; vm.memory[0x301] = 2; vm.memory[0x302] = 3;
+    bool debug = vm.debug;
+    std::shared_ptr<TraceBuffer> saved = vm.trace;
+    vm.debug = true;
+    vm.trace = std::make_shared<TraceBuffer>(4);
+    TraceBuffer& trace = *vm.trace;
+
+    // Run
+    for (int i = 0; i < 6; i++) {
+        vm.emulate_cycle();
+    }
+    trace.finish(vm);
+
+    // Assertions: the two oldest were overwritten, the rest are oldest first
+    ASSERT_TRUE(trace.size() == 4);
+    ASSERT_TRUE(trace.at(0).pc == 0x204 && trace.at(3).pc == 0x20A);
+    // FX65 changed three registers, and each keeps its value
+    char line[256];
+    format_trace_entry(trace.at(2), line, sizeof(line));
+    ASSERT_TRUE(!strcmp(line, "pc=208  op=F265  I=300  sp=0  dt=00  V0=01  V1=02  V2=03"));
+    // VF was written but did not change, so only V0 is listed
+    format_trace_entry(trace.at(3), line, sizeof(line));
+    ASSERT_TRUE(!strcmp(line, "pc=20A  op=8014  I=300  sp=0  dt=00  V0=03"));
+    vm.trace = saved;
+    vm.debug = debug;
+    return true;
+}
+
+bool Tests::test_decode() {
+    // decode() and emulate_cycle agree on which opcodes are illegal, in
+    // every variant: later instruction sets trap until the VM enables them
+    for (Variant variant : {Variant::Chip8, Variant::SuperChip, Variant::XoChip}) {
+        for (int opcode = 0; opcode < 0x10000; opcode++) {
+            reset();
+            vm.set_variant(variant);
+            unsigned char rom[] = {(unsigned char) (opcode >> 8), (unsigned char) (opcode & 0xFF)};
+            vm.load(rom, 2);
+            vm.sp = 1;  // so 00EE has somewhere to return to
+            Status status = vm.emulate_cycle();
+            Op op = decode(opcode);
+            bool illegal = op == Op::ILLEGAL || op_variant(op) > variant;
+            ASSERT_TRUE((status == Status::IllegalOpcode) == illegal);
+        }
+    }
+    return true;
+}
+
+bool Tests::test_disasm() {
+    // Setup: a call, a BNNN jump table with three entries and an unreachable word
+    unsigned char rom[] = {
+        0x60, 0x02,  // 200: LD V0, 2
+        0x22, 0x10,  // 202: CALL 0x210
+        0xB2, 0x08,  // 204: JP V0, 0x208
+        0x12, 0x06,  // 206: never reached
+        0x12, 0x0C,  // 208: JP 0x20C
+        0x12, 0x0E,  // 20A: JP 0x20E
+        0x12, 0x00,  // 20C: JP 0x200
+        0x00, 0xE0,  // 20E: CLS, falls into the subroutine
+        0x70, 0x01,  // 210: ADD V0, 1
+        0x00, 0xEE,  // 212: RET
+    };
+    vm.load(rom, sizeof(rom));
+
+    // Run
+    Analysis analysis;
+    analyze(vm.memory, sizeof(rom), Variant::Chip8, analysis);
+
+    // Assertions
+    ASSERT_TRUE(analysis.subroutines == std::set<uint16_t>({0x200, 0x210}));
+    ASSERT_TRUE(analysis.blocks.size() == 7);
+    ASSERT_TRUE(analysis.blocks[0x200].callee == 0x210);
+    ASSERT_TRUE(analysis.blocks[0x200].succs == std::vector<uint16_t>({0x204}));
+    ASSERT_TRUE(analysis.jump_tables[0x204] == std::vector<uint16_t>({0x208, 0x20A, 0x20C}));
+    ASSERT_TRUE(analysis.blocks[0x200].back_edges == std::vector<uint16_t>({0x20C}));
+    ASSERT_TRUE(!analysis.code[0x206] && !analysis.code[0x207]);
+    ASSERT_TRUE(analysis.blocks[0x20E].subroutine == 0x200);
+    ASSERT_TRUE(analysis.blocks[0x210].subroutine == 0x210);
+
+    // A skip over F000 NNNN lands past all four bytes only on XO-CHIP
+    reset();
+    unsigned char skip[] = {0x30, 0x00, 0xF0, 0x00, 0x12, 0x00, 0x12, 0x00};
+    vm.load(skip, sizeof(skip));
+    Analysis chip8, xochip;
+    analyze(vm.memory, sizeof(skip), Variant::Chip8, chip8);
+    analyze(vm.memory, sizeof(skip), Variant::XoChip, xochip);
+    ASSERT_TRUE(chip8.blocks[0x200].succs == std::vector<uint16_t>({0x202, 0x204}));
+    ASSERT_TRUE(xochip.blocks[0x200].succs == std::vector<uint16_t>({0x202, 0x206}));
+    return true;
+}
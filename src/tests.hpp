@@ -8,8 +8,10 @@ public:
 
     Tests(bool);
     void reset();
-    void run_tests();
+    int run_tests();  // returns the number of failed assertions
 private:
+    int m_failures = 0;
+
     bool test_00E0();
     bool test_00EE();
     bool test_1NNN();
@@ -44,4 +46,25 @@ private:
     bool test_FX33();
     bool test_FX55();
     bool test_FX65();
+    bool test_00CN();
+    bool test_00FB();
+    bool test_00FC();
+    bool test_00FF();
+    bool test_DXY0();
+    bool test_FX30();
+    bool test_FX75();
+    bool test_00DN();
+    bool test_5XY2();
+    bool test_F000();
+    bool test_FN01();
+    bool test_F002();
+    bool test_faults();
+    bool test_data_access();
+    bool test_frame_count();
+    bool test_stepper();
+    bool test_batch_vm();
+    bool test_vec_env();
+    bool test_trace();
+    bool test_decode();
+    bool test_disasm();
 };
@@ -0,0 +1,96 @@
+#include <string.h>
+
+#include "chip8.hpp"
+#include "trace.hpp"
+
+TraceBuffer::TraceBuffer(size_t entries) {
+    // Round up to a power of two so the ring index is a mask
+    size_t capacity = 1;
+    while (capacity < entries)
+        capacity <<= 1;
+    m_entries.resize(capacity);
+    m_mask = capacity - 1;
+}
+
+size_t TraceBuffer::size() const {
+    return m_count < m_entries.size() ? m_count : m_entries.size();
+}
+
+const TraceEntry& TraceBuffer::at(size_t i) const {
+    return m_entries[(m_count - size() + i) & m_mask];
+}
+
+void TraceBuffer::finish(const Chip8& vm) {
+    if (m_count == 0)
+        return;
+    TraceEntry& e = m_entries[(m_count - 1) & m_mask];
+    e.written = 0;
+    for (int i = 0; i < 16; i++) {
+        if (vm.V[i] != m_prev_v[i])
+            e.written |= 1 << i;
+    }
+    e.I = vm.I;
+    memcpy(e.v, vm.V, 16);
+    e.sp = vm.sp;
+    e.delay_timer = vm.delay_timer;
+}
+
+void TraceBuffer::record(const Chip8& vm) {
+    finish(vm);
+    TraceEntry& e = m_entries[m_count & m_mask];
+    e.pc = vm.pc;
+    e.opcode = vm.opcode;
+    memcpy(m_prev_v, vm.V, 16);
+    m_count++;
+}
+
+bool TraceBuffer::save(const Chip8& vm, const char* path) {
+    FILE* out = fopen(path, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "Failed to write trace %s\n", path);
+        return false;
+    }
+    finish(vm);
+
+    uint32_t header[4] = {TRACE_MAGIC, TRACE_VERSION, (uint32_t) sizeof(TraceEntry), (uint32_t) size()};
+    fwrite(header, sizeof(header), 1, out);
+    // Oldest entry first
+    uint64_t first = m_count - size();
+    for (uint64_t i = first; i < m_count; i++) {
+        fwrite(&m_entries[i & m_mask], sizeof(TraceEntry), 1, out);
+    }
+    fclose(out);
+    return true;
+}
+
+void format_trace_entry(const TraceEntry& e, char* out, size_t size) {
+    int len = snprintf(out, size, "pc=%03X  op=%04X  I=%03X  sp=%X  dt=%02X", e.pc, e.opcode, e.I, e.sp, e.delay_timer);
+    for (int i = 0; i < 16 && len >= 0 && (size_t) len < size; i++) {
+        if (e.written & (1 << i))
+            len += snprintf(out + len, size - len, "  V%X=%02X", i, e.v[i]);
+    }
+}
+
+int trace_dump(const char* path) {
+    FILE* in = fopen(path, "rb");
+    if (in == NULL) {
+        fprintf(stderr, "Failed to open trace %s\n", path);
+        return 1;
+    }
+    uint32_t header[4];
+    if (fread(header, sizeof(header), 1, in) != 1 || header[0] != TRACE_MAGIC
+        || header[1] != TRACE_VERSION || header[2] != sizeof(TraceEntry)) {
+        fprintf(stderr, "%s is not a chip8 trace\n", path);
+        fclose(in);
+        return 1;
+    }
+
+    TraceEntry e;
+    char line[256];
+    for (uint32_t n = 0; n < header[3] && fread(&e, sizeof(e), 1, in) == 1; n++) {
+        format_trace_entry(e, line, sizeof(line));
+        printf("%8u  %s\n", n, line);
+    }
+    fclose(in);
+    return 0;
+}
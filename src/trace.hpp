@@ -0,0 +1,59 @@
+#pragma once
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+/*
+  Binary instruction trace.
+
+  With CHIP8_DEBUG set, every emulate_cycle appends a 26-byte entry to an
+  in-memory ring buffer instead of printing, so emulation stays close to full
+  speed and the most recent TRACE_DEFAULT_ENTRIES instructions are always on
+  hand. The ring is written to a file on a trap or on SIGUSR1 and decoded with
+  ./chip8 trace <file>.
+
+  An entry's register fields describe the state after the instruction; they
+  are filled in when the next instruction starts, or when the trace is saved.
+  The dump lists every register the instruction changed with its new value.
+*/
+
+#define TRACE_DEFAULT_ENTRIES (1 << 20)
+#define TRACE_MAGIC 0x52543843  // "C8TR"
+#define TRACE_VERSION 2
+
+struct TraceEntry {
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t I;
+    uint16_t written;      // bitmask of V registers the instruction changed
+    uint8_t v[16];         // V after the instruction; the written ones are the news
+    uint8_t sp;
+    uint8_t delay_timer;
+};
+
+// One decoded line of ./chip8 trace, without the index or newline
+void format_trace_entry(const TraceEntry& e, char* out, size_t size);
+
+class Chip8;
+
+class TraceBuffer {
+public:
+    TraceBuffer(size_t entries = TRACE_DEFAULT_ENTRIES);
+    void record(const Chip8& vm);
+    // Fills in the results of the instruction in flight; record() and save() call it
+    void finish(const Chip8& vm);
+    bool save(const Chip8& vm, const char* path);
+    size_t size() const;
+    const TraceEntry& at(size_t i) const;  // i-th oldest of the size() entries kept
+
+private:
+    std::vector<TraceEntry> m_entries;
+    size_t m_mask;
+    uint64_t m_count = 0;
+    uint8_t m_prev_v[16];  // V before the instruction in flight
+};
+
+int trace_dump(const char* path);
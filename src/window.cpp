@@ -1,5 +1,23 @@
+#include <chrono>
+#include <vector>
+
 #include "window.hpp"
 
+// 3x5 glyphs for the overlay, one row per entry, high bit of three on the left
+static const char overlay_chars[] = "0123456789.ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+static const uint8_t overlay_font[][5] = {
+    {7,5,5,5,7}, {2,6,2,2,7}, {7,1,7,4,7}, {7,1,7,1,7}, {5,5,7,1,1},
+    {7,4,7,1,7}, {7,4,7,5,7}, {7,1,1,1,1}, {7,5,7,5,7}, {7,5,7,1,7},
+    {0,0,0,0,2},
+    {2,5,7,5,5}, {6,5,6,5,6}, {3,4,4,4,3}, {6,5,5,5,6}, {7,4,6,4,7},
+    {7,4,6,4,4}, {3,4,5,5,3}, {5,5,7,5,5}, {7,2,2,2,7}, {1,1,1,5,2},
+    {5,5,6,5,5}, {4,4,4,4,7}, {5,7,7,5,5}, {6,5,5,5,5}, {2,5,5,5,2},
+    {6,5,6,4,4}, {2,5,5,6,3}, {6,5,6,5,5}, {3,4,2,1,6}, {7,2,2,2,2},
+    {5,5,5,5,7}, {5,5,5,5,2}, {5,5,7,7,5}, {5,5,2,5,5}, {5,5,2,2,2},
+    {7,1,2,4,7},
+};
+#define OVERLAY_SCALE 3
+
 Window::Window(int height) {
     int width = height * 2;
     if (SDL_Init(SDL_INIT_EVERYTHING) < 0) {
@@ -37,9 +55,71 @@ void Window::quit() {
     SDL_Quit();
 }
 
-void Window::draw_screen(uint32_t* pixels, int num_pixels) {
-    SDL_UpdateTexture(m_sdl_texture, NULL, pixels, 64 * sizeof(Uint32));
+void Window::draw_screen(uint32_t* pixels, int width, int height, const char* overlay) {
+    auto start = std::chrono::steady_clock::now();
+    if (width != m_texture_width) {
+        SDL_DestroyTexture(m_sdl_texture);
+        m_sdl_texture = SDL_CreateTexture(
+            m_sdl_renderer,
+            SDL_PIXELFORMAT_ARGB8888,
+            SDL_TEXTUREACCESS_STREAMING,
+            width,
+            height
+        );
+        m_texture_width = width;
+    }
+    SDL_UpdateTexture(m_sdl_texture, NULL, pixels, width * sizeof(Uint32));
     SDL_RenderClear(m_sdl_renderer);
     SDL_RenderCopy(m_sdl_renderer, m_sdl_texture, NULL, NULL);
+    if (overlay != NULL) {
+        draw_text(overlay);
+    }
     SDL_RenderPresent(m_sdl_renderer);
+    m_last_draw_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+int64_t Window::last_draw_us() const {
+    return m_last_draw_us;
+}
+
+void Window::draw_text(const char* text) {
+    const int advance = 4 * OVERLAY_SCALE;
+    const int line_height = 6 * OVERLAY_SCALE;
+
+    // Every lit glyph pixel becomes a rect, submitted in one call
+    std::vector<SDL_Rect> rects;
+    int columns = 0, lines = 1, x = 0, y = 0;
+    for (const char* c = text; *c; c++) {
+        if (*c == '\n') {
+            x = 0;
+            y += line_height;
+            lines++;
+            continue;
+        }
+        const char* found = strchr(overlay_chars, *c);
+        if (found != NULL) {
+            const uint8_t* glyph = overlay_font[found - overlay_chars];
+            for (int row = 0; row < 5; row++) {
+                for (int col = 0; col < 3; col++) {
+                    if (glyph[row] & (4 >> col)) {
+                        SDL_Rect r = {OVERLAY_SCALE + x + col * OVERLAY_SCALE, OVERLAY_SCALE + y + row * OVERLAY_SCALE,
+                                      OVERLAY_SCALE, OVERLAY_SCALE};
+                        rects.push_back(r);
+                    }
+                }
+            }
+        }
+        x += advance;
+        if (x / advance > columns)
+            columns = x / advance;
+    }
+
+    SDL_Rect background = {0, 0, columns * advance + OVERLAY_SCALE, lines * line_height + OVERLAY_SCALE};
+    SDL_SetRenderDrawBlendMode(m_sdl_renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(m_sdl_renderer, 0, 0, 0, 192);
+    SDL_RenderFillRect(m_sdl_renderer, &background);
+    SDL_SetRenderDrawColor(m_sdl_renderer, 0, 255, 0, 255);
+    SDL_RenderFillRects(m_sdl_renderer, rects.data(), (int) rects.size());
+    SDL_SetRenderDrawColor(m_sdl_renderer, 0, 0, 0, 255);
 }
@@ -12,13 +12,21 @@ class Window {
 
 public:
     Window(int height);
-    void draw_screen(uint32_t* pixels, int num_pixels);
+    // pixels: width x height ARGB, stretched over the window (the texture is
+    // recreated when a SUPER-CHIP ROM switches resolution)
+    // overlay: optional newline-separated text drawn over the top-left corner
+    void draw_screen(uint32_t* pixels, int width, int height, const char* overlay = NULL);
+    int64_t last_draw_us() const;
     void quit();
 
 private:
+    void draw_text(const char* text);
+
     int m_width;
     int m_height;
     SDL_Window* m_sdl_window;
     SDL_Renderer* m_sdl_renderer;
     SDL_Texture* m_sdl_texture;
+    int m_texture_width = 64;
+    int64_t m_last_draw_us = 0;
 };